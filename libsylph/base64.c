@@ -26,7 +26,7 @@
 static const gchar base64char[64] =
 	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
-static const gchar base64val[128] = {
+static const gchar base64val[256] = {
 	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
 	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
 	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1, -1, 63,
@@ -34,27 +34,46 @@ static const gchar base64val[128] = {
 	-1,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
 	15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, -1,
 	-1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
-	41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1
+	41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
 };
 
-#define BASE64VAL(c)	(isascii((guchar)c) ? base64val[(gint)(c)] : -1)
+#define BASE64VAL(c)	(base64val[(guchar)(c)])
+
+/* encode ngroups groups of 3 bytes into 4 characters each, without
+   NUL termination */
+static void base64_encode_groups(gchar *out, const guchar *in, gint ngroups)
+{
+	while (ngroups-- > 0) {
+		guint32 v = (in[0] << 16) | (in[1] << 8) | in[2];
+
+		out[0] = base64char[(v >> 18) & 0x3f];
+		out[1] = base64char[(v >> 12) & 0x3f];
+		out[2] = base64char[(v >> 6) & 0x3f];
+		out[3] = base64char[v & 0x3f];
+
+		out += 4;
+		in += 3;
+	}
+}
 
 void base64_encode(gchar *out, const guchar *in, gint inlen)
 {
 	const guchar *inp = in;
 	gchar *outp = out;
+	gint ngroups = inlen / 3;
 
-	while (inlen >= 3) {
-		*outp++ = base64char[(inp[0] >> 2) & 0x3f];
-		*outp++ = base64char[((inp[0] & 0x03) << 4) |
-				     ((inp[1] >> 4) & 0x0f)];
-		*outp++ = base64char[((inp[1] & 0x0f) << 2) |
-				     ((inp[2] >> 6) & 0x03)];
-		*outp++ = base64char[inp[2] & 0x3f];
-
-		inp += 3;
-		inlen -= 3;
-	}
+	base64_encode_groups(outp, inp, ngroups);
+	outp += ngroups * 4;
+	inp += ngroups * 3;
+	inlen -= ngroups * 3;
 
 	if (inlen > 0) {
 		*outp++ = base64char[(inp[0] >> 2) & 0x3f];
@@ -113,6 +132,93 @@ gint base64_decode(guchar *out, const gchar *in, gint inlen)
 	return outp - out;
 }
 
+Base64Encoder *base64_encoder_new(void)
+{
+	Base64Encoder *encoder;
+
+	encoder = g_new0(Base64Encoder, 1);
+	return encoder;
+}
+
+void base64_encoder_free(Base64Encoder *encoder)
+{
+	g_free(encoder);
+}
+
+/* encode inlen bytes of in into lines of BASE64_LINE_LENGTH characters.
+   The output is not NUL-terminated. Up to 2 bytes are kept in the encoder
+   until the next call or base64_encoder_flush(). out must have at least
+   BASE64_ENCODER_OUTLEN(inlen) bytes. Returns the length of the output. */
+gint base64_encoder_encode(Base64Encoder *encoder, const guchar *in,
+			   gint inlen, gchar *out)
+{
+	gchar *outp = out;
+	gint len;
+
+	g_return_val_if_fail(encoder != NULL, -1);
+	g_return_val_if_fail(in != NULL || inlen == 0, -1);
+	g_return_val_if_fail(out != NULL, -1);
+
+	/* complete the pending group */
+	while (encoder->buf_len > 0 && encoder->buf_len < 3 && inlen > 0) {
+		encoder->buf[encoder->buf_len++] = *in++;
+		inlen--;
+	}
+	if (encoder->buf_len == 3) {
+		base64_encode_groups(outp, encoder->buf, 1);
+		outp += 4;
+		encoder->line_len += 4;
+		encoder->buf_len = 0;
+		if (encoder->line_len == BASE64_LINE_LENGTH) {
+			*outp++ = '\n';
+			encoder->line_len = 0;
+		}
+	}
+
+	while (inlen >= 3) {
+		len = MIN(inlen / 3, (BASE64_LINE_LENGTH - encoder->line_len) / 4);
+		base64_encode_groups(outp, in, len);
+		outp += len * 4;
+		encoder->line_len += len * 4;
+		in += len * 3;
+		inlen -= len * 3;
+		if (encoder->line_len == BASE64_LINE_LENGTH) {
+			*outp++ = '\n';
+			encoder->line_len = 0;
+		}
+	}
+
+	while (inlen > 0) {
+		encoder->buf[encoder->buf_len++] = *in++;
+		inlen--;
+	}
+
+	return outp - out;
+}
+
+/* encode the remaining bytes with padding and terminate the last line.
+   out must have at least 6 bytes. */
+gint base64_encoder_flush(Base64Encoder *encoder, gchar *out)
+{
+	gchar *outp = out;
+
+	g_return_val_if_fail(encoder != NULL, -1);
+	g_return_val_if_fail(out != NULL, -1);
+
+	if (encoder->buf_len > 0) {
+		base64_encode(outp, encoder->buf, encoder->buf_len);
+		outp += 4;
+		encoder->line_len += 4;
+		encoder->buf_len = 0;
+	}
+	if (encoder->line_len > 0) {
+		*outp++ = '\n';
+		encoder->line_len = 0;
+	}
+
+	return outp - out;
+}
+
 Base64Decoder *base64_decoder_new(void)
 {
 	Base64Decoder *decoder;
@@ -141,6 +247,27 @@ gint base64_decoder_decode(Base64Decoder *decoder,
 	memcpy(buf, decoder->buf, sizeof(buf));
 
 	for (;;) {
+		/* fast path: four valid characters at once */
+		while (buf_len == 0) {
+			gint v0, v1, v2, v3;
+
+			v0 = BASE64VAL(in[0]);
+			if (v0 < 0) break;
+			v1 = BASE64VAL(in[1]);
+			if (v1 < 0) break;
+			v2 = BASE64VAL(in[2]);
+			if (v2 < 0) break;
+			v3 = BASE64VAL(in[3]);
+			if (v3 < 0) break;
+
+			out[0] = (v0 << 2) | (v1 >> 4);
+			out[1] = ((v1 & 0x0f) << 4) | (v2 >> 2);
+			out[2] = ((v2 & 0x03) << 6) | v3;
+			out += 3;
+			total_len += 3;
+			in += 4;
+		}
+
 		while (buf_len < 4) {
 			gchar c = *in;
 
@@ -22,8 +22,22 @@
 
 #include <glib.h>
 
+typedef struct _Base64Encoder	Base64Encoder;
 typedef struct _Base64Decoder	Base64Decoder;
 
+#define BASE64_LINE_LENGTH	76
+
+/* maximum output length of base64_encoder_encode() */
+#define BASE64_ENCODER_OUTLEN(inlen)			\
+	(((inlen) + 2) / 3 * 4 + ((inlen) + 2) / 3 * 4 / BASE64_LINE_LENGTH + 1)
+
+struct _Base64Encoder
+{
+	gint buf_len;
+	guchar buf[3];
+	gint line_len;
+};
+
 struct _Base64Decoder
 {
 	gint buf_len;
@@ -37,6 +51,15 @@ gint base64_decode	(guchar		*out,
 			 const gchar	*in,
 			 gint		 inlen);
 
+Base64Encoder *base64_encoder_new	(void);
+void	       base64_encoder_free	(Base64Encoder	*encoder);
+gint	       base64_encoder_encode	(Base64Encoder	*encoder,
+					 const guchar	*in,
+					 gint		 inlen,
+					 gchar		*out);
+gint	       base64_encoder_flush	(Base64Encoder	*encoder,
+					 gchar		*out);
+
 Base64Decoder *base64_decoder_new	(void);
 void	       base64_decoder_free	(Base64Decoder	*decoder);
 gint	       base64_decoder_decode	(Base64Decoder	*decoder,
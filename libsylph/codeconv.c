@@ -854,9 +854,10 @@ static gchar *conv_euctoutf8(const gchar *inbuf, gint *error)
 	return ret;
 }
 
-static gchar *conv_anytoutf8(const gchar *inbuf, gint *error)
+static gchar *conv_jatoutf8(const gchar *inbuf, CharSet charset,
+			    gint *error)
 {
-	switch (conv_guess_ja_encoding(inbuf)) {
+	switch (charset) {
 	case C_ISO_2022_JP:
 		return conv_jistoutf8(inbuf, error);
 	case C_SHIFT_JIS:
@@ -876,6 +877,11 @@ static gchar *conv_anytoutf8(const gchar *inbuf, gint *error)
 	}
 }
 
+static gchar *conv_anytoutf8(const gchar *inbuf, gint *error)
+{
+	return conv_jatoutf8(inbuf, conv_guess_ja_encoding(inbuf), error);
+}
+
 static gchar *conv_utf8tosjis(const gchar *inbuf, gint *error)
 {
 	static iconv_t cd = (iconv_t)-1;
@@ -1255,6 +1261,171 @@ CharSet conv_guess_ja_encoding(const gchar *str)
 	return guessed;
 }
 
+/* number of UTF-8 characters after which UTF-8 is assumed */
+#define CONV_GUESS_UTF8_CERTAIN	64
+/* bytes of text examined by CodeConverter in auto detection mode */
+#define CONV_GUESS_MAX_LEN	(64 * 1024)
+
+ConvJaGuesser *conv_ja_guesser_new(gsize max_len)
+{
+	ConvJaGuesser *guesser;
+
+	guesser = g_new(ConvJaGuesser, 1);
+	guesser->max_len = max_len;
+	conv_ja_guesser_reset(guesser);
+
+	return guesser;
+}
+
+void conv_ja_guesser_reset(ConvJaGuesser *guesser)
+{
+	g_return_if_fail(guesser != NULL);
+
+	guesser->guessed = C_US_ASCII;
+	guesser->decided = FALSE;
+	guesser->lead = 0;
+	guesser->is_utf8 = TRUE;
+	guesser->utf8_left = 0;
+	guesser->utf8_count = 0;
+	guesser->len = 0;
+}
+
+void conv_ja_guesser_free(ConvJaGuesser *guesser)
+{
+	g_free(guesser);
+}
+
+/* the same rules as conv_guess_ja_encoding(), one byte at a time.
+   Returns TRUE if the result is final. */
+static gboolean conv_ja_guesser_step(ConvJaGuesser *guesser, guchar c)
+{
+	guchar lead;
+
+	if (guesser->lead == 0) {
+		if (c == ESC || !isascii(c))
+			guesser->lead = c;
+		return FALSE;
+	}
+
+	lead = guesser->lead;
+	guesser->lead = 0;
+
+	if (lead == ESC) {
+		if (c == '$' || c == '(') {
+			if (guesser->guessed == C_US_ASCII) {
+				guesser->guessed = C_ISO_2022_JP;
+				return TRUE;
+			}
+			return FALSE;
+		}
+	} else if (iseuckanji(lead) && iseuckanji(c)) {
+		if (lead >= 0xfd && lead <= 0xfe) {
+			guesser->guessed = C_EUC_JP;
+			return TRUE;
+		} else if (guesser->guessed == C_SHIFT_JIS) {
+			if ((issjiskanji1(lead) && issjiskanji2(c)) ||
+			    issjishwkana(lead))
+				guesser->guessed = C_SHIFT_JIS;
+			else
+				guesser->guessed = C_EUC_JP;
+		} else
+			guesser->guessed = C_EUC_JP;
+		return FALSE;
+	} else if (issjiskanji1(lead) && issjiskanji2(c)) {
+		guesser->guessed = C_SHIFT_JIS;
+		return FALSE;
+	} else if (issjishwkana(lead)) {
+		guesser->guessed = C_SHIFT_JIS;
+	} else if (guesser->guessed == C_US_ASCII)
+		guesser->guessed = C_AUTO;
+
+	/* c begins the next character */
+	return conv_ja_guesser_step(guesser, c);
+}
+
+/* feed the next len bytes (or up to NUL if len < 0) of the input. Returns
+   TRUE if the encoding is decided and no more input is needed. */
+gboolean conv_ja_guesser_feed(ConvJaGuesser *guesser, const gchar *str,
+			      gint len)
+{
+	const guchar *p = (const guchar *)str;
+	const guchar *end;
+
+	g_return_val_if_fail(guesser != NULL, TRUE);
+	g_return_val_if_fail(str != NULL, guesser->decided);
+
+	if (guesser->decided)
+		return TRUE;
+
+	if (len < 0)
+		len = strlen(str);
+	end = p + len;
+
+	for (; p < end; p++) {
+		/* skip ASCII quickly */
+		if (guesser->lead == 0 && guesser->utf8_left == 0 &&
+		    isascii(*p) && *p != ESC)
+			continue;
+
+		if (guesser->is_utf8) {
+			if (guesser->utf8_left > 0) {
+				if (!isutf8_3_2(*p))
+					guesser->is_utf8 = FALSE;
+				else if (--guesser->utf8_left == 0)
+					guesser->utf8_count++;
+			} else if (!isascii(*p)) {
+				if (isutf8_3_1(*p))
+					guesser->utf8_left = 2;
+				else
+					guesser->is_utf8 = FALSE;
+			}
+		} else
+			guesser->utf8_left = 0;
+
+		if (conv_ja_guesser_step(guesser, *p)) {
+			/* ISO-2022-JP or EUC-JP for certain */
+			guesser->is_utf8 = FALSE;
+			guesser->decided = TRUE;
+			p++;
+			break;
+		}
+	}
+
+	guesser->len += p - (const guchar *)str;
+
+	if (guesser->max_len > 0 && !guesser->decided) {
+		if (guesser->len >= guesser->max_len ||
+		    (guesser->is_utf8 &&
+		     guesser->utf8_count >= CONV_GUESS_UTF8_CERTAIN))
+			guesser->decided = TRUE;
+	}
+
+	return guesser->decided;
+}
+
+CharSet conv_ja_guesser_get_result(ConvJaGuesser *guesser)
+{
+	ConvJaGuesser tmp;
+
+	g_return_val_if_fail(guesser != NULL, C_AUTO);
+
+	/* finish the pending character as if followed by NUL */
+	tmp = *guesser;
+	if (tmp.lead != 0 && tmp.lead != ESC) {
+		if (issjishwkana(tmp.lead))
+			tmp.guessed = C_SHIFT_JIS;
+		else if (tmp.guessed == C_US_ASCII)
+			tmp.guessed = C_AUTO;
+	}
+	if (tmp.utf8_left > 0)
+		tmp.is_utf8 = FALSE;
+
+	if (tmp.guessed != C_US_ASCII && tmp.is_utf8)
+		return C_UTF_8;
+
+	return tmp.guessed;
+}
+
 static gchar *conv_jistodisp(const gchar *inbuf, gint *error)
 {
 	return conv_jistoutf8(inbuf, error);
@@ -1272,7 +1443,7 @@ static gchar *conv_euctodisp(const gchar *inbuf, gint *error)
 
 gchar *conv_utf8todisp(const gchar *inbuf, gint *error)
 {
-	if (g_utf8_validate(inbuf, -1, NULL) == TRUE) {
+	if (is_utf8_str(inbuf)) {
 		if (error)
 			*error = 0;
 		if (isutf8bom(inbuf))
@@ -1282,11 +1453,12 @@ gchar *conv_utf8todisp(const gchar *inbuf, gint *error)
 		return conv_ustodisp(inbuf, error);
 }
 
-static gchar *conv_anytodisp(const gchar *inbuf, gint *error)
+static gchar *conv_jatodisp(const gchar *inbuf, CharSet charset,
+			    gint *error)
 {
 	gchar *outbuf;
 
-	outbuf = conv_anytoutf8(inbuf, error);
+	outbuf = conv_jatoutf8(inbuf, charset, error);
 	if (g_utf8_validate(outbuf, -1, NULL) != TRUE) {
 		if (error)
 			*error = -1;
@@ -1296,6 +1468,11 @@ static gchar *conv_anytodisp(const gchar *inbuf, gint *error)
 	return outbuf;
 }
 
+static gchar *conv_anytodisp(const gchar *inbuf, gint *error)
+{
+	return conv_jatodisp(inbuf, conv_guess_ja_encoding(inbuf), error);
+}
+
 static gchar *conv_ustodisp(const gchar *inbuf, gint *error)
 {
 	gchar *outbuf;
@@ -1360,11 +1537,19 @@ CodeConverter *conv_code_converter_new(const gchar *src_encoding,
 	conv->src_encoding = g_strdup(src_encoding);
 	conv->dest_encoding = g_strdup(dest_encoding);
 
+	/* guess the encoding from the beginning of the text once instead of
+	   guessing every line separately */
+	if (conv->code_conv_func == conv_anytodisp)
+		conv->guesser = conv_ja_guesser_new(CONV_GUESS_MAX_LEN);
+	conv->guessed_charset = C_AUTO;
+
 	return conv;
 }
 
 void conv_code_converter_destroy(CodeConverter *conv)
 {
+	if (conv->guesser)
+		conv_ja_guesser_free(conv->guesser);
 	g_free(conv->src_encoding);
 	g_free(conv->dest_encoding);
 	g_free(conv);
@@ -1374,7 +1559,22 @@ gchar *conv_convert(CodeConverter *conv, const gchar *inbuf)
 {
 	if (!inbuf)
 		return NULL;
-	else if (conv->code_conv_func != conv_noconv)
+
+	if (conv->guesser && conv_ja_guesser_feed(conv->guesser, inbuf, -1)) {
+		CharSet charset;
+
+		charset = conv_ja_guesser_get_result(conv->guesser);
+		conv_ja_guesser_free(conv->guesser);
+		conv->guesser = NULL;
+		/* keep guessing per line if nothing Japanese was found */
+		if (charset == C_ISO_2022_JP || charset == C_SHIFT_JIS ||
+		    charset == C_EUC_JP || charset == C_UTF_8)
+			conv->guessed_charset = charset;
+	}
+	if (conv->guessed_charset != C_AUTO)
+		return conv_jatodisp(inbuf, conv->guessed_charset, NULL);
+
+	if (conv->code_conv_func != conv_noconv)
 		return conv->code_conv_func(inbuf, NULL);
 	else
 		return conv_iconv_strdup
@@ -1501,30 +1701,164 @@ CodeConvFunc conv_get_code_conv_func(const gchar *src_encoding,
 	return code_conv;
 }
 
+/* Cache of iconv descriptors used by conv_iconv_strdup().
+   Each thread has its own cache, so the descriptors are never shared
+   between threads. The most recently used entry comes first. */
+
+#define CONV_ICONV_CACHE_SIZE	8
+
+typedef struct _ConvIconvCacheEntry
+{
+	gchar *src_code;
+	gchar *dest_code;
+	iconv_t cd;
+} ConvIconvCacheEntry;
+
+#if USE_THREADS
+static GStaticPrivate iconv_cache_key = G_STATIC_PRIVATE_INIT;
+#else
+static GQueue *iconv_cache = NULL;
+#endif
+
+static void conv_iconv_cache_entry_free(ConvIconvCacheEntry *entry)
+{
+	if (entry->cd != (iconv_t)-1)
+		iconv_close(entry->cd);
+	g_free(entry->src_code);
+	g_free(entry->dest_code);
+	g_free(entry);
+}
+
+#if USE_THREADS
+static void conv_iconv_cache_free(gpointer data)
+{
+	GQueue *cache = (GQueue *)data;
+	ConvIconvCacheEntry *entry;
+
+	while ((entry = g_queue_pop_head(cache)) != NULL)
+		conv_iconv_cache_entry_free(entry);
+	g_queue_free(cache);
+}
+#endif
+
+static GQueue *conv_iconv_cache_get(void)
+{
+	GQueue *cache;
+
+#if USE_THREADS
+	cache = g_static_private_get(&iconv_cache_key);
+	if (!cache) {
+		cache = g_queue_new();
+		g_static_private_set(&iconv_cache_key, cache,
+				     conv_iconv_cache_free);
+	}
+#else
+	if (!iconv_cache)
+		iconv_cache = g_queue_new();
+	cache = iconv_cache;
+#endif
+
+	return cache;
+}
+
+/* returns (iconv_t)-1 if the conversion is not supported.
+   The returned descriptor must not be closed. */
+static iconv_t conv_iconv_open_cached(const gchar *dest_code,
+				      const gchar *src_code)
+{
+	GQueue *cache;
+	GList *cur;
+	ConvIconvCacheEntry *entry;
+
+	cache = conv_iconv_cache_get();
+
+	for (cur = cache->head; cur != NULL; cur = cur->next) {
+		entry = (ConvIconvCacheEntry *)cur->data;
+		if (!strcmp(entry->src_code, src_code) &&
+		    !strcmp(entry->dest_code, dest_code)) {
+			if (cur != cache->head) {
+				g_queue_unlink(cache, cur);
+				g_queue_push_head_link(cache, cur);
+			}
+			/* reset the shift state */
+			if (entry->cd != (iconv_t)-1)
+				iconv(entry->cd, NULL, NULL, NULL, NULL);
+			return entry->cd;
+		}
+	}
+
+	/* unsupported conversions are also cached */
+	entry = g_new(ConvIconvCacheEntry, 1);
+	entry->src_code = g_strdup(src_code);
+	entry->dest_code = g_strdup(dest_code);
+	entry->cd = iconv_open(dest_code, src_code);
+	g_queue_push_head(cache, entry);
+
+	if (g_queue_get_length(cache) > CONV_ICONV_CACHE_SIZE)
+		conv_iconv_cache_entry_free
+			((ConvIconvCacheEntry *)g_queue_pop_tail(cache));
+
+	return entry->cd;
+}
+
+/* returns TRUE if US-ASCII characters are encoded as they are */
+static gboolean conv_is_ascii_compatible(CharSet charset)
+{
+	switch (charset) {
+	case C_AUTO:
+	case C_UTF_7:
+	case C_SHIFT_JIS:
+		return FALSE;
+	default:
+		return TRUE;
+	}
+}
+
+/* returns TRUE if inbuf is already valid in dest_code and iconv()
+   would not change it */
+static gboolean conv_is_noconv_str(const gchar *inbuf, const gchar *src_code,
+				   const gchar *dest_code)
+{
+	CharSet src_charset;
+	CharSet dest_charset;
+
+	src_charset = conv_get_charset_from_str(src_code);
+	dest_charset = conv_get_charset_from_str(dest_code);
+
+	if (src_charset == C_UTF_8 && dest_charset == C_UTF_8)
+		return is_utf8_str(inbuf);
+	if (conv_is_ascii_compatible(src_charset) &&
+	    conv_is_ascii_compatible(dest_charset))
+		return is_ascii_str(inbuf);
+
+	return FALSE;
+}
+
 gchar *conv_iconv_strdup(const gchar *inbuf,
 			 const gchar *src_code, const gchar *dest_code,
 			 gint *error)
 {
 	iconv_t cd;
-	gchar *outbuf;
 
 	if (!src_code)
 		src_code = conv_get_locale_charset_str();
 	if (!dest_code)
 		dest_code = CS_INTERNAL;
 
-	cd = iconv_open(dest_code, src_code);
+	if (inbuf && conv_is_noconv_str(inbuf, src_code, dest_code)) {
+		if (error)
+			*error = 0;
+		return g_strdup(inbuf);
+	}
+
+	cd = conv_iconv_open_cached(dest_code, src_code);
 	if (cd == (iconv_t)-1) {
 		if (error)
 			*error = -1;
 		return NULL;
 	}
 
-	outbuf = conv_iconv_strdup_with_cd(inbuf, cd, error);
-
-	iconv_close(cd);
-
-	return outbuf;
+	return conv_iconv_strdup_with_cd(inbuf, cd, error);
 }
 
 gchar *conv_iconv_strdup_with_cd(const gchar *inbuf, iconv_t cd, gint *error)
@@ -2670,7 +3004,7 @@ CharSet conv_check_file_encoding(const gchar *file)
 		gchar *str;
 		gint error = 0;
 
-		if (is_locale) {
+		if (is_locale && !is_ascii_str(buf)) {
 			str = conv_codeset_strdup_full(buf, enc_str,
 						       CS_INTERNAL, &error);
 			if (!str || error != 0)
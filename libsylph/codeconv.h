@@ -28,6 +28,7 @@
 #include <iconv.h>
 
 typedef struct _CodeConverter	CodeConverter;
+typedef struct _ConvJaGuesser	ConvJaGuesser;
 
 typedef enum
 {
@@ -109,6 +110,25 @@ struct _CodeConverter
 	CodeConvFunc code_conv_func;
 	gchar *src_encoding;
 	gchar *dest_encoding;
+
+	/* auto detection mode */
+	ConvJaGuesser *guesser;
+	CharSet guessed_charset;
+};
+
+/* incremental version of conv_guess_ja_encoding() */
+struct _ConvJaGuesser
+{
+	CharSet guessed;
+	gboolean decided;
+
+	guchar lead;		/* pending first byte of a character */
+	gboolean is_utf8;	/* all characters so far are 3-byte UTF-8 */
+	gint utf8_left;		/* remaining bytes of a UTF-8 character */
+	gint utf8_count;
+
+	gsize len;
+	gsize max_len;		/* decide after this many bytes (0 = never) */
 };
 
 #define CS_AUTO			"AUTO"
@@ -188,6 +208,14 @@ struct _CodeConverter
 
 CharSet conv_guess_ja_encoding		(const gchar	*str);
 
+ConvJaGuesser *conv_ja_guesser_new	(gsize		 max_len);
+void conv_ja_guesser_reset		(ConvJaGuesser	*guesser);
+void conv_ja_guesser_free		(ConvJaGuesser	*guesser);
+gboolean conv_ja_guesser_feed		(ConvJaGuesser	*guesser,
+					 const gchar	*str,
+					 gint		 len);
+CharSet conv_ja_guesser_get_result	(ConvJaGuesser	*guesser);
+
 gchar *conv_utf8todisp			(const gchar	*inbuf,
 					 gint		*error);
 gchar *conv_localetodisp		(const gchar	*inbuf,
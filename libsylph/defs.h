@@ -79,10 +79,12 @@
 #define FOLDER_LIST		"folderlist.xml"
 #define CACHE_FILE		".sylpheed_cache"
 #define MARK_FILE		".sylpheed_mark"
+#define MIME_CACHE_FILE		".sylpheed_mime_cache"
 #define SEARCH_CACHE		"search_cache"
 #define CACHE_VERSION		0x21
 #define MARK_VERSION		2
 #define SEARCH_CACHE_VERSION	1
+#define MIME_CACHE_VERSION	1
 
 #ifdef G_OS_WIN32
 #  define REMOTE_CMD_PORT	50215
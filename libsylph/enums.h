@@ -58,6 +58,8 @@ typedef enum
 	S_COL_FOREGROUND,
 	S_COL_BOLD,
 
+	S_COL_SORT_KEY,
+
 	N_SUMMARY_COLS
 } SummaryColumnType;
 
@@ -61,9 +61,11 @@ static gboolean filter_match_cond	(FilterCond	*cond,
 					 GSList		*hlist,
 					 FilterInfo	*fltinfo);
 static gboolean filter_match_header_cond(FilterCond	*cond,
+					 MsgInfo	*msginfo,
 					 GSList		*hlist);
 static gboolean filter_match_in_addressbook
 					(FilterCond	*cond,
+					 MsgInfo	*msginfo,
 					 GSList		*hlist,
 					 FilterInfo	*fltinfo);
 
@@ -464,16 +466,18 @@ static gboolean filter_match_cond(FilterCond *cond, MsgInfo *msginfo,
 	switch (cond->type) {
 	case FLT_COND_HEADER:
 		if (cond->match_type == FLT_IN_ADDRESSBOOK)
-			return filter_match_in_addressbook(cond, hlist, fltinfo);
+			return filter_match_in_addressbook(cond, msginfo, hlist,
+							   fltinfo);
 		else
-			return filter_match_header_cond(cond, hlist);
+			return filter_match_header_cond(cond, msginfo, hlist);
 	case FLT_COND_ANY_HEADER:
-		return filter_match_header_cond(cond, hlist);
+		return filter_match_header_cond(cond, msginfo, hlist);
 	case FLT_COND_TO_OR_CC:
 		if (cond->match_type == FLT_IN_ADDRESSBOOK)
-			return filter_match_in_addressbook(cond, hlist, fltinfo);
+			return filter_match_in_addressbook(cond, msginfo, hlist,
+							   fltinfo);
 		else
-			return filter_match_header_cond(cond, hlist);
+			return filter_match_header_cond(cond, msginfo, hlist);
 	case FLT_COND_BODY:
 		matched = procmime_find_string(msginfo, cond->str_value,
 					       cond->match_func);
@@ -566,46 +570,89 @@ static gboolean filter_match_cond(FilterCond *cond, MsgInfo *msginfo,
 	return matched;
 }
 
-static gboolean filter_match_header_cond(FilterCond *cond, GSList *hlist)
+#define FLT_MSGINFO_HEADERS	6
+
+/* fill hdrs[] with the headers held in the summary cache, without copying */
+static gint filter_get_msginfo_headers(MsgInfo *msginfo, Header *hdrs)
+{
+	gint n = 0;
+
+#define SET_HEADER(hname, hbody)		\
+{						\
+	if (hbody) {				\
+		hdrs[n].name = hname;		\
+		hdrs[n].body = hbody;		\
+		n++;				\
+	}					\
+}
+
+	SET_HEADER("Subject", msginfo->subject);
+	SET_HEADER("From", msginfo->from);
+	SET_HEADER("To", msginfo->to);
+	SET_HEADER("Cc", msginfo->cc);
+	SET_HEADER("Newsgroups", msginfo->newsgroups);
+	SET_HEADER("Date", msginfo->date);
+
+#undef SET_HEADER
+
+	return n;
+}
+
+static gboolean filter_match_header(FilterCond *cond, Header *header)
+{
+	switch (cond->type) {
+	case FLT_COND_HEADER:
+		if (!g_ascii_strcasecmp(header->name, cond->header_name)) {
+			if (!cond->str_value ||
+			    cond->match_func(header->body, cond->str_value))
+				return TRUE;
+		}
+		break;
+	case FLT_COND_ANY_HEADER:
+		if (!cond->str_value ||
+		    cond->match_func(header->body, cond->str_value))
+			return TRUE;
+		break;
+	case FLT_COND_TO_OR_CC:
+		if (!g_ascii_strcasecmp(header->name, "To") ||
+		    !g_ascii_strcasecmp(header->name, "Cc")) {
+			if (!cond->str_value ||
+			    cond->match_func(header->body, cond->str_value))
+				return TRUE;
+		}
+		break;
+	default:
+		break;
+	}
+
+	return FALSE;
+}
+
+/* if hlist is NULL, the headers in the summary cache of msginfo are used */
+static gboolean filter_match_header_cond(FilterCond *cond, MsgInfo *msginfo,
+					 GSList *hlist)
 {
 	gboolean matched = FALSE;
 	gboolean not_match = FALSE;
 	GSList *cur;
-	Header *header;
+	Header hdrs[FLT_MSGINFO_HEADERS];
+	gint i, n;
 
-	for (cur = hlist; cur != NULL; cur = cur->next) {
-		header = (Header *)cur->data;
-
-		switch (cond->type) {
-		case FLT_COND_HEADER:
-			if (!g_ascii_strcasecmp
-				(header->name, cond->header_name)) {
-				if (!cond->str_value ||
-				    cond->match_func(header->body,
-						     cond->str_value))
-					matched = TRUE;
+	if (hlist) {
+		for (cur = hlist; cur != NULL; cur = cur->next) {
+			if (filter_match_header(cond, (Header *)cur->data)) {
+				matched = TRUE;
+				break;
 			}
-			break;
-		case FLT_COND_ANY_HEADER:
-			if (!cond->str_value ||
-			    cond->match_func(header->body, cond->str_value))
+		}
+	} else if (msginfo) {
+		n = filter_get_msginfo_headers(msginfo, hdrs);
+		for (i = 0; i < n; i++) {
+			if (filter_match_header(cond, &hdrs[i])) {
 				matched = TRUE;
-			break;
-		case FLT_COND_TO_OR_CC:
-			if (!g_ascii_strcasecmp(header->name, "To") ||
-			    !g_ascii_strcasecmp(header->name, "Cc")) {
-				if (!cond->str_value ||
-				    cond->match_func(header->body,
-						     cond->str_value))
-					matched = TRUE;
+				break;
 			}
-			break;
-		default:
-			break;
 		}
-
-		if (matched == TRUE)
-			break;
 	}
 
 	if (FLT_IS_NOT_MATCH(cond->match_flag)) {
@@ -635,38 +682,52 @@ static gboolean filter_match_header_cond(FilterCond *cond, GSList *hlist)
 	return matched;
 }
 
-static gboolean filter_match_in_addressbook(FilterCond *cond, GSList *hlist,
-					    FilterInfo *fltinfo)
+static gboolean filter_match_header_in_addressbook(FilterCond *cond,
+						   Header *header)
+{
+	if (cond->type == FLT_COND_HEADER) {
+		if (!g_ascii_strcasecmp(header->name, cond->header_name))
+			return default_addrbook_func(header->body);
+	} else if (cond->type == FLT_COND_TO_OR_CC) {
+		if (!g_ascii_strcasecmp(header->name, "To") ||
+		    !g_ascii_strcasecmp(header->name, "Cc"))
+			return default_addrbook_func(header->body);
+	}
+
+	return FALSE;
+}
+
+static gboolean filter_match_in_addressbook(FilterCond *cond, MsgInfo *msginfo,
+					    GSList *hlist, FilterInfo *fltinfo)
 {
 	gboolean matched = FALSE;
 	gboolean not_match = FALSE;
 	GSList *cur;
-	Header *header;
+	Header hdrs[FLT_MSGINFO_HEADERS];
+	gint i, n;
 
 	if (!default_addrbook_func)
 		return FALSE;
 	if (cond->type != FLT_COND_HEADER && cond->type != FLT_COND_TO_OR_CC)
 		return FALSE;
 
-	for (cur = hlist; cur != NULL; cur = cur->next) {
-		header = (Header *)cur->data;
-
-		if (cond->type == FLT_COND_HEADER) {
-			if (!g_ascii_strcasecmp
-				(header->name, cond->header_name)) {
-				if (default_addrbook_func(header->body))
-					matched = TRUE;
+	if (hlist) {
+		for (cur = hlist; cur != NULL; cur = cur->next) {
+			if (filter_match_header_in_addressbook
+				(cond, (Header *)cur->data)) {
+				matched = TRUE;
+				break;
 			}
-		} else if (cond->type == FLT_COND_TO_OR_CC) {
-			if (!g_ascii_strcasecmp(header->name, "To") ||
-			    !g_ascii_strcasecmp(header->name, "Cc")) {
-				if (default_addrbook_func(header->body))
-					matched = TRUE;
+		}
+	} else if (msginfo) {
+		n = filter_get_msginfo_headers(msginfo, hdrs);
+		for (i = 0; i < n; i++) {
+			if (filter_match_header_in_addressbook
+				(cond, &hdrs[i])) {
+				matched = TRUE;
+				break;
 			}
 		}
-
-		if (matched == TRUE)
-			break;
 	}
 
 	if (FLT_IS_NOT_MATCH(cond->match_flag)) {
@@ -692,6 +753,63 @@ static gboolean filter_match_in_addressbook(FilterCond *cond, GSList *hlist,
 	return matched;
 }
 
+static gboolean filter_is_summary_header(const gchar *name)
+{
+	return (g_ascii_strcasecmp(name, "Date") == 0 ||
+		g_ascii_strcasecmp(name, "From") == 0 ||
+		g_ascii_strcasecmp(name, "To") == 0 ||
+		g_ascii_strcasecmp(name, "Newsgroups") == 0 ||
+		g_ascii_strcasecmp(name, "Subject") == 0);
+}
+
+/* Returns the NULL-terminated list of the header names which the rule
+   needs but the summary cache doesn't hold, or NULL if the rule needs no
+   such header or needs all of them (FLT_COND_ANY_HEADER). The result
+   should be freed with g_strfreev(). */
+gchar **filter_rule_get_required_headers(FilterRule *rule)
+{
+	GSList *cur;
+	GPtrArray *array;
+
+	g_return_val_if_fail(rule != NULL, NULL);
+
+	array = g_ptr_array_new();
+
+	for (cur = rule->cond_list; cur != NULL; cur = cur->next) {
+		FilterCond *cond = (FilterCond *)cur->data;
+		const gchar *name = NULL;
+		guint i;
+
+		if (cond->type == FLT_COND_ANY_HEADER) {
+			g_ptr_array_add(array, NULL);
+			g_strfreev((gchar **)g_ptr_array_free(array, FALSE));
+			return NULL;
+		} else if (cond->type == FLT_COND_TO_OR_CC)
+			name = "Cc";
+		else if (cond->type == FLT_COND_HEADER && cond->header_name &&
+			 !filter_is_summary_header(cond->header_name))
+			name = cond->header_name;
+
+		if (!name)
+			continue;
+		for (i = 0; i < array->len; i++) {
+			if (!g_ascii_strcasecmp
+				((gchar *)g_ptr_array_index(array, i), name))
+				break;
+		}
+		if (i == array->len)
+			g_ptr_array_add(array, g_strdup(name));
+	}
+
+	if (array->len == 0) {
+		g_ptr_array_free(array, TRUE);
+		return NULL;
+	}
+
+	g_ptr_array_add(array, NULL);
+	return (gchar **)g_ptr_array_free(array, FALSE);
+}
+
 gboolean filter_rule_requires_full_headers(FilterRule *rule)
 {
 	GSList *cur;
@@ -701,11 +819,7 @@ gboolean filter_rule_requires_full_headers(FilterRule *rule)
 		const gchar *name = cond->header_name;
 
 		if (cond->type == FLT_COND_HEADER && name) {
-			if (g_ascii_strcasecmp(name, "Date") != 0 &&
-			    g_ascii_strcasecmp(name, "From") != 0 &&
-			    g_ascii_strcasecmp(name, "To") != 0 &&
-			    g_ascii_strcasecmp(name, "Newsgroups") != 0 &&
-			    g_ascii_strcasecmp(name, "Subject") != 0)
+			if (!filter_is_summary_header(name))
 				return TRUE;
 		} else if (cond->type == FLT_COND_ANY_HEADER ||
 			   cond->type == FLT_COND_TO_OR_CC)
@@ -184,6 +184,7 @@ gboolean filter_match_rule		(FilterRule		*rule,
 					 FilterInfo		*fltinfo);
 
 gboolean filter_rule_requires_full_headers	(FilterRule	*rule);
+gchar **filter_rule_get_required_headers	(FilterRule	*rule);
 
 /* read / write config */
 GSList *filter_xml_node_to_filter_list	(GNode			*node);
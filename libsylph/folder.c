@@ -221,6 +221,7 @@ FolderItem *folder_item_new(const gchar *name, const gchar *path)
 	item->updated = FALSE;
 	item->cache_dirty = FALSE;
 	item->mark_dirty = FALSE;
+	item->mime_cache_dirty = FALSE;
 	item->node = NULL;
 	item->parent = NULL;
 	item->folder = NULL;
@@ -232,6 +233,7 @@ FolderItem *folder_item_new(const gchar *name, const gchar *path)
 	item->auto_bcc = NULL;
 	item->auto_replyto = NULL;
 	item->mark_queue = NULL;
+	item->mime_cache = NULL;
 	item->last_selected = 0;
 	item->qsearch_cond_type = 0;
 	item->data = NULL;
@@ -266,6 +268,7 @@ FolderItem *folder_item_copy(FolderItem *item)
 	new_item->total = item->total;
 	new_item->unmarked_num = item->unmarked_num;
 	new_item->last_num = item->last_num;
+	new_item->scan_mtime = item->scan_mtime;
 	new_item->no_sub = item->no_sub;
 	new_item->no_select = item->no_select;
 	new_item->collapsed = item->collapsed;
@@ -362,6 +365,8 @@ void folder_item_destroy(FolderItem *item)
 	g_free(item->auto_cc);
 	g_free(item->auto_bcc);
 	g_free(item->auto_replyto);
+	if (item->mime_cache)
+		g_hash_table_destroy(item->mime_cache);
 	g_free(item);
 }
 
@@ -1448,6 +1453,24 @@ gchar *folder_item_get_mark_file(FolderItem *item)
 	return file;
 }
 
+gchar *folder_item_get_mime_cache_file(FolderItem *item)
+{
+	gchar *path;
+	gchar *file;
+
+	g_return_val_if_fail(item != NULL, NULL);
+	g_return_val_if_fail(item->path != NULL, NULL);
+
+	path = folder_item_get_path(item);
+	g_return_val_if_fail(path != NULL, NULL);
+	if (!is_dir_exist(path))
+		make_dir_hier(path);
+	file = g_strconcat(path, G_DIR_SEPARATOR_S, MIME_CACHE_FILE, NULL);
+	g_free(path);
+
+	return file;
+}
+
 static gboolean folder_build_tree(GNode *node, gpointer data)
 {
 	Folder *folder = FOLDER(data);
@@ -287,6 +287,7 @@ struct _FolderItem
 
 	guint cache_dirty : 1; /* cache file needs to be updated */
 	guint mark_dirty  : 1; /* mark file needs to be updated */
+	guint mime_cache_dirty : 1; /* MIME cache file needs to be updated */
 
 	FolderSortKey sort_key;
 	FolderSortType sort_type;
@@ -313,10 +314,16 @@ struct _FolderItem
 	GSList *cache_queue;
 	GSList *mark_queue;
 
+	GHashTable *mime_cache; /* msgnum -> MIME structure */
+
 	guint last_selected;
 	gint qsearch_cond_type;
 
 	gpointer data;
+
+	/* latest mtime of the folder and its mark file when the counters
+	   were last counted (0 if unknown, not saved) */
+	time_t scan_mtime;
 };
 
 Folder     *folder_new			(FolderType	 type,
@@ -444,6 +451,7 @@ gboolean folder_item_is_msg_changed	(FolderItem	*item,
 /* return value is filename encoding */
 gchar *folder_item_get_cache_file	(FolderItem	*item);
 gchar *folder_item_get_mark_file	(FolderItem	*item);
+gchar *folder_item_get_mime_cache_file	(FolderItem	*item);
 
 gint   folder_item_close		(FolderItem	*item);
 
@@ -60,6 +60,10 @@
 #define IMAP_COPY_LIMIT	200
 #define IMAP_CMD_LIMIT	1000
 
+/* messages are fetched in parts of this size so that an interrupted
+   download can be resumed */
+#define IMAP_FETCH_CHUNK_SIZE	(1024 * 1024)
+
 #define QUOTE_IF_REQUIRED(out, str)					\
 {									\
 	if (*str != '"' && strpbrk(str, " \t(){}[]%&*") != NULL) {	\
@@ -363,6 +367,7 @@ static gint imap_cmd_search	(IMAPSession	*session,
 				 GArray        **result);
 static gint imap_cmd_fetch	(IMAPSession	*session,
 				 guint32	 uid,
+				 guint32	 uid_validity,
 				 const gchar	*filename);
 static gint imap_cmd_append	(IMAPSession	*session,
 				 const gchar	*destfolder,
@@ -414,6 +419,10 @@ static GSList *imap_get_seq_set_from_msglist	(GSList		*msglist,
 static gint imap_seq_set_get_count		(const gchar	*seq_set);
 static void imap_seq_set_free			(GSList		*seq_list);
 
+static void imap_remove_partial_files		(const gchar	*dir,
+						 guint32	 first,
+						 guint32	 last);
+
 static GHashTable *imap_get_uid_table		(GArray		*array);
 
 static gboolean imap_rename_folder_func		(GNode		*node,
@@ -1268,7 +1277,7 @@ static gchar *imap_fetch_msg(Folder *folder, FolderItem *item, gint uid)
 
 	status_print(_("Getting message %u"), uid32);
 	debug_print("getting message %u...\n", uid32);
-	ok = imap_cmd_fetch(session, uid32, filename);
+	ok = imap_cmd_fetch(session, uid32, (guint32)item->mtime, filename);
 
 	if (ok != IMAP_SUCCESS) {
 		g_warning("can't fetch message %u\n", uid32);
@@ -1720,8 +1729,10 @@ static gint imap_remove_msgs(Folder *folder, FolderItem *item, GSList *msglist)
 		MsgInfo *msginfo = (MsgInfo *)cur->data;
 		guint32 uid = msginfo->msgnum;
 
-		if (dir_exist)
+		if (dir_exist) {
 			remove_numbered_files(dir, uid, uid);
+			imap_remove_partial_files(dir, uid, uid);
+		}
 		item->total--;
 		if (MSG_IS_NEW(msginfo->flags))
 			item->new--;
@@ -1775,8 +1786,10 @@ static gint imap_remove_all_msg(Folder *folder, FolderItem *item)
 	item->updated = TRUE;
 
 	dir = folder_item_get_path(item);
-	if (is_dir_exist(dir))
+	if (is_dir_exist(dir)) {
 		remove_all_numbered_files(dir);
+		imap_remove_partial_files(dir, 0, G_MAXUINT32);
+	}
 	g_free(dir);
 
 	return IMAP_SUCCESS;
@@ -2837,8 +2850,10 @@ static GSList *imap_delete_cached_messages(GSList *mlist, FolderItem *item,
 		    first_uid, last_uid);
 
 	dir = folder_item_get_path(item);
-	if (is_dir_exist(dir))
+	if (is_dir_exist(dir)) {
 		remove_numbered_files(dir, first_uid, last_uid);
+		imap_remove_partial_files(dir, first_uid, last_uid);
+	}
 	g_free(dir);
 
 	for (cur = mlist; cur != NULL; ) {
@@ -2859,6 +2874,36 @@ static GSList *imap_delete_cached_messages(GSList *mlist, FolderItem *item,
 	return mlist;
 }
 
+/* remove the partially fetched messages (<uid>.<uidvalidity>.part) whose
+   UID is within first - last */
+static void imap_remove_partial_files(const gchar *dir, guint32 first,
+				      guint32 last)
+{
+	GDir *dp;
+	const gchar *dir_name;
+	gchar *end;
+	gchar *file;
+	guint32 uid;
+
+	if ((dp = g_dir_open(dir, 0, NULL)) == NULL)
+		return;
+
+	while ((dir_name = g_dir_read_name(dp)) != NULL) {
+		if (!g_ascii_isdigit(*dir_name) ||
+		    !g_str_has_suffix(dir_name, ".part"))
+			continue;
+		uid = strtoul(dir_name, &end, 10);
+		if (*end != '.' || uid < first || uid > last)
+			continue;
+		file = g_strconcat(dir, G_DIR_SEPARATOR_S, dir_name, NULL);
+		if (g_unlink(file) < 0)
+			FILE_OP_ERROR(file, "unlink");
+		g_free(file);
+	}
+
+	g_dir_close(dp);
+}
+
 static void imap_delete_all_cached_messages(FolderItem *item)
 {
 	gchar *dir;
@@ -2870,8 +2915,10 @@ static void imap_delete_all_cached_messages(FolderItem *item)
 	debug_print("Deleting all cached messages... ");
 
 	dir = folder_item_get_path(item);
-	if (is_dir_exist(dir))
+	if (is_dir_exist(dir)) {
 		remove_all_numbered_files(dir);
+		imap_remove_partial_files(dir, 0, G_MAXUINT32);
+	}
 	g_free(dir);
 
 	debug_print("done.\n");
@@ -4119,20 +4166,24 @@ catch:
 typedef struct _IMAPCmdFetchData
 {
 	guint32 uid;
-	const gchar *filename;
+	FILE *fp;
+	glong size;
 } IMAPCmdFetchData;
 
 #define THROW(err) { ok = err; goto catch; }
 
 static gint imap_cmd_fetch_func(IMAPSession *session, gpointer data)
 {
-	const gchar *filename = ((IMAPCmdFetchData *)data)->filename;
+	IMAPCmdFetchData *fetch_data = (IMAPCmdFetchData *)data;
 	gint ok;
 	gchar *buf;
 	gchar *cur_pos;
 	gchar size_str[32];
 	glong size_num;
-	gint ret;
+	gchar *literal;
+	gboolean write_err = FALSE;
+
+	fetch_data->size = 0;
 
 	while ((ok = imap_cmd_gen_recv(session, &buf)) == IMAP_SUCCESS) {
 		if (buf[0] != '*' || buf[1] != ' ') {
@@ -4145,6 +4196,14 @@ static gint imap_cmd_fetch_func(IMAPSession *session, gpointer data)
 	if (ok != IMAP_SUCCESS)
 		THROW(ok);
 
+	cur_pos = strchr(buf, '{');
+	if (!cur_pos && buf[0] != '\0' && buf[strlen(buf) - 1] == ')') {
+		/* empty string: the offset exceeded the message size */
+		g_free(buf);
+		ok = imap_cmd_ok_real(session, NULL);
+		THROW(ok);
+	}
+
 #define RETURN_ERROR_IF_FAIL(cond)			\
 	if (!(cond)) {					\
 		g_free(buf);				\
@@ -4152,7 +4211,6 @@ static gint imap_cmd_fetch_func(IMAPSession *session, gpointer data)
 		THROW(IMAP_ERROR);			\
 	}
 
-	cur_pos = strchr(buf, '{');
 	RETURN_ERROR_IF_FAIL(cur_pos != NULL);
 	cur_pos = strchr_cpy(cur_pos + 1, '}', size_str, sizeof(size_str));
 	RETURN_ERROR_IF_FAIL(cur_pos != NULL);
@@ -4165,14 +4223,19 @@ static gint imap_cmd_fetch_func(IMAPSession *session, gpointer data)
 
 	g_free(buf);
 
-	if ((ret = recv_bytes_write_to_file(SESSION(session)->sock,
-					    size_num, filename)) != 0) {
-		if (ret == -2)
+	if (size_num > 0) {
+		literal = recv_bytes(SESSION(session)->sock, size_num);
+		if (!literal)
 			THROW(IMAP_SOCKET);
+		if (fwrite(literal, size_num, 1, fetch_data->fp) != 1) {
+			FILE_OP_ERROR("imap_cmd_fetch_func", "fwrite");
+			write_err = TRUE;
+		}
+		g_free(literal);
 	}
 
-	if (imap_cmd_gen_recv(session, &buf) != IMAP_SUCCESS)
-		THROW(IMAP_ERROR);
+	if ((ok = imap_cmd_gen_recv(session, &buf)) != IMAP_SUCCESS)
+		THROW(ok);
 
 	if (buf[0] == '\0' || buf[strlen(buf) - 1] != ')') {
 		g_free(buf);
@@ -4182,9 +4245,11 @@ static gint imap_cmd_fetch_func(IMAPSession *session, gpointer data)
 
 	ok = imap_cmd_ok_real(session, NULL);
 
-	if (ret != 0)
+	if (write_err)
 		THROW(IMAP_ERROR);
 
+	fetch_data->size = size_num;
+
 catch:
 	return ok;
 }
@@ -4192,22 +4257,76 @@ catch:
 #undef THROW
 
 static gint imap_cmd_fetch(IMAPSession *session, guint32 uid,
-			   const gchar *filename)
+			   guint32 uid_validity, const gchar *filename)
 {
 	gint ok;
-	IMAPCmdFetchData fetch_data = {uid, filename};
+	IMAPCmdFetchData fetch_data = {uid, NULL, 0};
+	gchar *partial;
+	FILE *fp;
+	glong offset;
 
 	g_return_val_if_fail(filename != NULL, IMAP_ERROR);
 
-	ok = imap_cmd_gen_send(session, "UID FETCH %u BODY.PEEK[]", uid);
-	if (ok != IMAP_SUCCESS)
-		return ok;
+	/* the raw data is first stored to the partial file, which is
+	   kept if the connection is lost so that the next fetch can
+	   continue from there. The UIDVALIDITY in its name ensures that
+	   it is never resumed with another message of the same UID. */
+	partial = g_strdup_printf("%s.%u.part", filename, uid_validity);
+	if ((fp = g_fopen(partial, "ab")) == NULL) {
+		FILE_OP_ERROR(partial, "fopen");
+		g_free(partial);
+		return IMAP_ERROR;
+	}
+	if (fseek(fp, 0, SEEK_END) < 0 || (offset = ftell(fp)) < 0) {
+		FILE_OP_ERROR(partial, "fseek");
+		fclose(fp);
+		g_free(partial);
+		return IMAP_ERROR;
+	}
+	if (offset > 0)
+		debug_print("resuming message %u from offset %ld\n",
+			    uid, offset);
+
+	fetch_data.fp = fp;
+
+	do {
+		ok = imap_cmd_gen_send(session,
+				       "UID FETCH %u BODY.PEEK[]<%ld.%d>",
+				       uid, offset, IMAP_FETCH_CHUNK_SIZE);
+		if (ok != IMAP_SUCCESS)
+			break;
 
 #if USE_THREADS
-	ok = imap_thread_run(session, imap_cmd_fetch_func, &fetch_data);
+		ok = imap_thread_run(session, imap_cmd_fetch_func,
+				     &fetch_data);
 #else
-	ok = imap_cmd_fetch_func(session, &fetch_data);
+		ok = imap_cmd_fetch_func(session, &fetch_data);
 #endif
+		if (ok != IMAP_SUCCESS)
+			break;
+
+		if (fflush(fp) == EOF) {
+			FILE_OP_ERROR(partial, "fflush");
+			ok = IMAP_ERROR;
+			break;
+		}
+		offset += fetch_data.size;
+	} while (fetch_data.size == IMAP_FETCH_CHUNK_SIZE);
+
+	if (fclose(fp) == EOF) {
+		FILE_OP_ERROR(partial, "fclose");
+		if (ok == IMAP_SUCCESS)
+			ok = IMAP_ERROR;
+	}
+
+	if (ok == IMAP_SUCCESS) {
+		if (uncanonicalize_file(partial, filename) < 0)
+			ok = IMAP_ERROR;
+		g_unlink(partial);
+	} else if (ok != IMAP_SOCKET)
+		g_unlink(partial);
+
+	g_free(partial);
 
 	return ok;
 }
@@ -4242,10 +4361,8 @@ static gint imap_cmd_append(IMAPSession *session, const gchar *destfolder,
 	gchar *flag_str;
 	guint new_uid_;
 	gchar *ret = NULL;
-	gchar buf[BUFFSIZE];
 	FILE *fp;
 	FILE *tmp;
-	size_t read_len;
 	GPtrArray *argbuf;
 	gchar *resp_str;
 
@@ -4293,17 +4410,7 @@ static gint imap_cmd_append(IMAPSession *session, const gchar *destfolder,
 
 	log_print("IMAP4> %s\n", _("(sending file...)"));
 
-	while ((read_len = fread(buf, 1, sizeof(buf), tmp)) > 0) {
-		if (read_len < sizeof(buf) && ferror(tmp))
-			break;
-		if (sock_write_all(SESSION(session)->sock, buf, read_len) < 0) {
-			fclose(tmp);
-			return -1;
-		}
-	}
-
-	if (ferror(tmp)) {
-		FILE_OP_ERROR(file, "fread");
+	if (sock_write_file_all(SESSION(session)->sock, tmp, 0, size) < 0) {
 		fclose(tmp);
 		return -1;
 	}
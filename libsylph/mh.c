@@ -116,6 +116,8 @@ static gboolean mh_is_msg_changed	(Folder		*folder,
 static gint    mh_close			(Folder		*folder,
 					 FolderItem	*item);
 
+static time_t  mh_get_folder_stamp	(FolderItem	*item,
+					 const gchar	*path);
 static gint    mh_scan_folder_full	(Folder		*folder,
 					 FolderItem	*item,
 					 gboolean	 count_sum);
@@ -938,9 +940,18 @@ static gboolean mh_is_msg_changed(Folder *folder, FolderItem *item,
 				  MsgInfo *msginfo)
 {
 	struct stat s;
+	gchar *path, *file;
 	gchar buf[16];
+	gint ret;
+
+	path = folder_item_get_path(item);
+	file = g_strconcat(path, G_DIR_SEPARATOR_S,
+			   utos_buf(buf, msginfo->msgnum), NULL);
+	ret = g_stat(file, &s);
+	g_free(file);
+	g_free(path);
 
-	if (g_stat(utos_buf(buf, msginfo->msgnum), &s) < 0 ||
+	if (ret < 0 ||
 	    msginfo->size  != s.st_size ||
 	    msginfo->mtime != s.st_mtime)
 		return TRUE;
@@ -1038,10 +1049,36 @@ static BOOL find_next_file(HANDLE hfind, struct wfddata *wfd)
 }
 #endif
 
+/* Return the latest mtime of the folder directory and its mark file. If
+   it is unchanged since the last count, neither the message files nor the
+   flags have changed. */
+static time_t mh_get_folder_stamp(FolderItem *item, const gchar *path)
+{
+	struct stat s;
+	gchar *file;
+	time_t stamp;
+
+	if (g_stat(path, &s) < 0)
+		return 0;
+	stamp = s.st_mtime;
+
+	file = g_strconcat(path, G_DIR_SEPARATOR_S, MARK_FILE, NULL);
+	if (g_stat(file, &s) == 0 && s.st_mtime > stamp)
+		stamp = s.st_mtime;
+	g_free(file);
+
+	/* a change within the current second would not be seen */
+	if (stamp >= time(NULL))
+		return 0;
+
+	return stamp;
+}
+
 static gint mh_scan_folder_full(Folder *folder, FolderItem *item,
 				gboolean count_sum)
 {
 	gchar *path;
+	time_t stamp = 0;
 #ifdef G_OS_WIN32
 	struct wfddata wfd;
 	HANDLE hfind;
@@ -1064,6 +1101,21 @@ static gint mh_scan_folder_full(Folder *folder, FolderItem *item,
 		S_UNLOCK(mh);
 		return -1;
 	}
+
+	if (count_sum) {
+		stamp = mh_get_folder_stamp(item, path);
+		if (stamp != 0 && stamp == item->scan_mtime &&
+		    item->last_num >= 0 &&
+		    !item->cache_queue && !item->mark_queue) {
+			debug_print("mh_scan_folder(): %s is not changed\n",
+				    item->path);
+			g_free(path);
+			S_UNLOCK(mh);
+			return 0;
+		}
+	}
+	item->scan_mtime = 0;
+
 	if (change_dir(path) < 0) {
 		g_free(path);
 		S_UNLOCK(mh);
@@ -1146,6 +1198,8 @@ static gint mh_scan_folder_full(Folder *folder, FolderItem *item,
 
 	debug_print("Last number in dir %s = %d\n", item->path, max);
 	item->last_num = max;
+	if (count_sum)
+		item->scan_mtime = stamp;
 
 	S_UNLOCK(mh);
 	return 0;
@@ -1476,6 +1530,7 @@ static time_t mh_get_mtime(FolderItem *item)
 static GSList *mh_get_uncached_msgs(GHashTable *msg_table, FolderItem *item)
 {
 	gchar *path;
+	gchar *file;
 	GDir *dp;
 	const gchar *dir_name;
 	GSList *newlist = NULL;
@@ -1490,16 +1545,14 @@ static GSList *mh_get_uncached_msgs(GHashTable *msg_table, FolderItem *item)
 
 	folder = item->folder;
 
+	/* this may run in a worker thread, so don't depend on the current
+	   directory */
 	path = folder_item_get_path(item);
 	g_return_val_if_fail(path != NULL, NULL);
-	if (change_dir(path) < 0) {
-		g_free(path);
-		return NULL;
-	}
-	g_free(path);
 
-	if ((dp = g_dir_open(".", 0, NULL)) == NULL) {
-		FILE_OP_ERROR(item->path, "opendir");
+	if ((dp = g_dir_open(path, 0, NULL)) == NULL) {
+		FILE_OP_ERROR(path, "opendir");
+		g_free(path);
 		return NULL;
 	}
 
@@ -1518,8 +1571,12 @@ static GSList *mh_get_uncached_msgs(GHashTable *msg_table, FolderItem *item)
 				MSG_SET_TMP_FLAGS(msginfo->flags, MSG_CACHED);
 			} else {
 				/* not found in the cache (uncached message) */
-				msginfo = mh_parse_msg(dir_name, item);
+				file = g_strconcat(path, G_DIR_SEPARATOR_S,
+						   dir_name, NULL);
+				msginfo = mh_parse_msg(file, item);
+				g_free(file);
 				if (!msginfo) continue;
+				msginfo->msgnum = num;
 
 				if (!newlist)
 					last = newlist =
@@ -1538,10 +1595,14 @@ static GSList *mh_get_uncached_msgs(GHashTable *msg_table, FolderItem *item)
 	} else {
 		/* discard all previous cache */
 		while ((dir_name = g_dir_read_name(dp)) != NULL) {
-			if (to_number(dir_name) <= 0) continue;
+			if ((num = to_number(dir_name)) <= 0) continue;
 
-			msginfo = mh_parse_msg(dir_name, item);
+			file = g_strconcat(path, G_DIR_SEPARATOR_S, dir_name,
+					   NULL);
+			msginfo = mh_parse_msg(file, item);
+			g_free(file);
 			if (!msginfo) continue;
+			msginfo->msgnum = num;
 
 			if (!newlist)
 				last = newlist = g_slist_append(NULL, msginfo);
@@ -1556,6 +1617,7 @@ static GSList *mh_get_uncached_msgs(GHashTable *msg_table, FolderItem *item)
 	}
 
 	g_dir_close(dp);
+	g_free(path);
 
 	if (n_newmsg)
 		debug_print("%d uncached message(s) found.\n", n_newmsg);
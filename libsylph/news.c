@@ -53,6 +53,32 @@
 #define NNTPS_PORT	563
 #endif
 
+/* number of articles requested by one XOVER command */
+#define NEWS_XOVER_CHUNK_SIZE	5000
+
+typedef enum
+{
+	NEWS_XHDR_TO,
+	NEWS_XHDR_CC
+} NewsXhdrType;
+
+typedef enum
+{
+	NEWS_XOVER_OK,
+	NEWS_XOVER_FAILED,	/* error reply, e.g. no articles in the range */
+	NEWS_XOVER_UNSUPPORTED,	/* the command is unknown to the server */
+	NEWS_XOVER_BROKEN	/* the compressed data could not be decoded */
+} NewsXoverStatus;
+
+typedef struct _NewsOverviewData
+{
+	FolderItem *item;
+	GSList *mlist;
+	GSList *mlast;
+	GSList *cur;
+	NewsXhdrType header;
+} NewsOverviewData;
+
 static void news_folder_init		 (Folder	*folder,
 					  const gchar	*name,
 					  const gchar	*path);
@@ -113,6 +139,15 @@ static GSList *news_get_uncached_articles(NNTPSession	*session,
 					  gint		 cache_last,
 					  gint		*rfirst,
 					  gint		*rlast);
+static gint news_send_overview_cmds	 (NNTPSession	*session,
+					  gint		 first,
+					  gint		 last,
+					  gboolean	 compress);
+static gint news_recv_overview		 (NNTPSession	*session,
+					  FolderItem	*item,
+					  gboolean	 compress,
+					  NewsXoverStatus *status,
+					  GSList       **mlist);
 static MsgInfo *news_parse_xover	 (const gchar	*xover_str);
 static gchar *news_parse_xhdr		 (const gchar	*xhdr_str,
 					  MsgInfo	*msginfo);
@@ -780,10 +815,15 @@ static GSList *news_get_uncached_articles(NNTPSession *session,
 {
 	gint ok;
 	gint num = 0, first = 0, last = 0, begin = 0, end = 0;
-	gchar buf[NNTPBUFSIZE];
+	gint cbegin, cend, nbegin, nend;
 	GSList *newlist = NULL;
 	GSList *llast = NULL;
-	MsgInfo *msginfo;
+	GSList *mlist;
+	GSList *retry_list = NULL, *cur;
+	gboolean compress = FALSE;
+	gboolean ccompress, ncompress;
+	gboolean probing;
+	NewsXoverStatus status;
 	gint max_articles;
 
 	if (rfirst) *rfirst = -1;
@@ -831,112 +871,223 @@ static GSList *news_get_uncached_articles(NNTPSession *session,
 
 	log_message(_("getting xover %d - %d in %s...\n"),
 		    begin, end, item->path);
-	ok = nntp_xover(session, begin, end);
-	if (ok != NN_SUCCESS) {
-		log_warning(_("can't get xover\n"));
-		if (ok == NN_SOCKET) {
-			session_destroy(SESSION(session));
-			REMOTE_FOLDER(item->folder)->session = NULL;
-		}
-		return NULL;
-	}
 
-	for (;;) {
-		if (sock_gets(SESSION(session)->sock, buf, sizeof(buf)) < 0) {
-			log_warning(_("error occurred while getting xover.\n"));
-			session_destroy(SESSION(session));
-			REMOTE_FOLDER(item->folder)->session = NULL;
-			return newlist;
+#if HAVE_LIBZ
+	compress = !session->xzver_failed;
+#endif
+	/* wait for the first response before pipelining if the server
+	   may not support XZVER */
+	probing = compress;
+
+	cbegin = begin;
+	cend = MIN(end, begin + NEWS_XOVER_CHUNK_SIZE - 1);
+	ccompress = compress;
+	ok = news_send_overview_cmds(session, cbegin, cend, ccompress);
+
+	while (ok == NN_SUCCESS) {
+		/* request the next range before reading the current one */
+		nbegin = cend + 1;
+		nend = MIN(end, nbegin + NEWS_XOVER_CHUNK_SIZE - 1);
+		ncompress = compress;
+		if (nbegin <= end && !probing)
+			ok = news_send_overview_cmds(session, nbegin, nend,
+						     ncompress);
+		if (ok != NN_SUCCESS)
+			break;
+
+		mlist = NULL;
+		ok = news_recv_overview(session, item, ccompress, &status,
+					&mlist);
+		if (mlist) {
+			if (!newlist)
+				newlist = mlist;
+			else
+				llast->next = mlist;
+			llast = g_slist_last(mlist);
 		}
-
-		if (buf[0] == '.' && buf[1] == '\r') break;
-
-		msginfo = news_parse_xover(buf);
-		if (!msginfo) {
-			log_warning(_("invalid xover line: %s\n"), buf);
-			continue;
+		if (ok != NN_SUCCESS)
+			break;
+
+		if (status == NEWS_XOVER_UNSUPPORTED ||
+		    status == NEWS_XOVER_BROKEN) {
+			/* the commands of the next range may be already
+			   sent, so get this range with XOVER later */
+			retry_list = g_slist_prepend(retry_list,
+						     GINT_TO_POINTER(cbegin));
+			if (status == NEWS_XOVER_UNSUPPORTED) {
+				debug_print("XZVER is not supported. "
+					    "Using XOVER.\n");
+				session->xzver_failed = TRUE;
+				compress = FALSE;
+			}
+		} else if (status == NEWS_XOVER_FAILED)
+			debug_print("can't get xover %d - %d\n", cbegin, cend);
+
+		if (probing) {
+			probing = FALSE;
+			ncompress = compress;
+			if (nbegin <= end)
+				ok = news_send_overview_cmds(session, nbegin,
+							     nend, ncompress);
 		}
 
-		msginfo->folder = item;
-		msginfo->flags.perm_flags = MSG_NEW|MSG_UNREAD;
-		msginfo->flags.tmp_flags = MSG_NEWS;
-		msginfo->newsgroups = g_strdup(item->path);
+		if (nbegin > end)
+			break;
+		cbegin = nbegin;
+		cend = nend;
+		ccompress = ncompress;
+	}
 
-		if (!newlist)
-			llast = newlist = g_slist_append(newlist, msginfo);
-		else {
-			llast = g_slist_append(llast, msginfo);
-			llast = llast->next;
-		}
+	retry_list = g_slist_reverse(retry_list);
+	for (cur = retry_list; cur != NULL && ok == NN_SUCCESS;
+	     cur = cur->next) {
+		cbegin = GPOINTER_TO_INT(cur->data);
+		cend = MIN(end, cbegin + NEWS_XOVER_CHUNK_SIZE - 1);
+		debug_print("retrying xover %d - %d\n", cbegin, cend);
+
+		ok = news_send_overview_cmds(session, cbegin, cend, FALSE);
+		if (ok != NN_SUCCESS)
+			break;
+		mlist = NULL;
+		ok = news_recv_overview(session, item, FALSE, &status, &mlist);
+		newlist = g_slist_concat(newlist, mlist);
+		if (ok == NN_SUCCESS && status != NEWS_XOVER_OK)
+			debug_print("can't get xover %d - %d\n", cbegin, cend);
 	}
+	if (retry_list)
+		newlist = g_slist_sort
+			(newlist, (GCompareFunc)procmsg_cmp_msgnum_for_sort);
+	g_slist_free(retry_list);
 
-	ok = nntp_xhdr(session, "to", begin, end);
 	if (ok != NN_SUCCESS) {
-		log_warning(_("can't get xhdr\n"));
-		if (ok == NN_SOCKET) {
-			session_destroy(SESSION(session));
-			REMOTE_FOLDER(item->folder)->session = NULL;
-		}
+		log_warning(_("error occurred while getting xover.\n"));
+		session_destroy(SESSION(session));
+		REMOTE_FOLDER(item->folder)->session = NULL;
 		return newlist;
 	}
 
-	llast = newlist;
+	session_set_access_time(SESSION(session));
 
-	for (;;) {
-		if (sock_gets(SESSION(session)->sock, buf, sizeof(buf)) < 0) {
-			log_warning(_("error occurred while getting xhdr.\n"));
-			session_destroy(SESSION(session));
-			REMOTE_FOLDER(item->folder)->session = NULL;
-			return newlist;
-		}
+	return newlist;
+}
 
-		if (buf[0] == '.' && buf[1] == '\r') break;
-		if (!llast) {
-			g_warning("llast == NULL\n");
-			continue;
-		}
+static gint news_send_overview_cmds(NNTPSession *session, gint first,
+				    gint last, gboolean compress)
+{
+	gint ok;
+
+	ok = nntp_xover_send(session, first, last, compress);
+	if (ok == NN_SUCCESS)
+		ok = nntp_xhdr_send(session, "to", first, last);
+	if (ok == NN_SUCCESS)
+		ok = nntp_xhdr_send(session, "cc", first, last);
 
-		msginfo = (MsgInfo *)llast->data;
-		msginfo->to = news_parse_xhdr(buf, msginfo);
+	return ok;
+}
 
-		llast = llast->next;
+static void news_xover_func(const gchar *line, gpointer data)
+{
+	NewsOverviewData *ov = (NewsOverviewData *)data;
+	MsgInfo *msginfo;
+
+	msginfo = news_parse_xover(line);
+	if (!msginfo) {
+		log_warning(_("invalid xover line: %s\n"), line);
+		return;
 	}
 
-	ok = nntp_xhdr(session, "cc", begin, end);
-	if (ok != NN_SUCCESS) {
-		log_warning(_("can't get xhdr\n"));
-		if (ok == NN_SOCKET) {
-			session_destroy(SESSION(session));
-			REMOTE_FOLDER(item->folder)->session = NULL;
-		}
-		return newlist;
+	msginfo->folder = ov->item;
+	msginfo->flags.perm_flags = MSG_NEW|MSG_UNREAD;
+	msginfo->flags.tmp_flags = MSG_NEWS;
+	msginfo->newsgroups = g_strdup(ov->item->path);
+
+	if (!ov->mlist)
+		ov->mlast = ov->mlist = g_slist_append(NULL, msginfo);
+	else {
+		ov->mlast = g_slist_append(ov->mlast, msginfo);
+		ov->mlast = ov->mlast->next;
 	}
+}
 
-	llast = newlist;
+static void news_xhdr_func(const gchar *line, gpointer data)
+{
+	NewsOverviewData *ov = (NewsOverviewData *)data;
+	MsgInfo *msginfo;
+	gint num;
 
-	for (;;) {
-		if (sock_gets(SESSION(session)->sock, buf, sizeof(buf)) < 0) {
-			log_warning(_("error occurred while getting xhdr.\n"));
-			session_destroy(SESSION(session));
-			REMOTE_FOLDER(item->folder)->session = NULL;
-			return newlist;
-		}
+	num = atoi(line);
 
-		if (buf[0] == '.' && buf[1] == '\r') break;
-		if (!llast) {
-			g_warning("llast == NULL\n");
-			continue;
-		}
+	/* both lists are in ascending order of the article number */
+	while (ov->cur && ((MsgInfo *)ov->cur->data)->msgnum < num)
+		ov->cur = ov->cur->next;
+	if (!ov->cur)
+		return;
 
-		msginfo = (MsgInfo *)llast->data;
-		msginfo->cc = news_parse_xhdr(buf, msginfo);
+	msginfo = (MsgInfo *)ov->cur->data;
+	if (msginfo->msgnum != num)
+		return;
 
-		llast = llast->next;
+	if (ov->header == NEWS_XHDR_TO) {
+		g_free(msginfo->to);
+		msginfo->to = news_parse_xhdr(line, msginfo);
+	} else {
+		g_free(msginfo->cc);
+		msginfo->cc = news_parse_xhdr(line, msginfo);
 	}
+}
 
-	session_set_access_time(SESSION(session));
+/* read the responses of the commands sent by news_send_overview_cmds() */
+static gint news_recv_overview(NNTPSession *session, FolderItem *item,
+			       gboolean compress, NewsXoverStatus *status,
+			       GSList **mlist)
+{
+	NewsOverviewData ov = {NULL, NULL, NULL, NULL, NEWS_XHDR_TO};
+	gchar buf[NNTPBUFSIZE];
+	gint ok;
 
-	return newlist;
+	ov.item = item;
+	*status = NEWS_XOVER_FAILED;
+
+	buf[0] = '\0';
+	ok = nntp_recv_status(session, buf);
+	if (ok == NN_SUCCESS) {
+		ok = nntp_recv_data(session, compress, news_xover_func, &ov);
+		if (ok == NN_SUCCESS)
+			*status = NEWS_XOVER_OK;
+		else if (ok == NN_IOERR) {
+			/* broken compressed data */
+			procmsg_msg_list_free(ov.mlist);
+			ov.mlist = NULL;
+			*status = NEWS_XOVER_BROKEN;
+			ok = NN_SUCCESS;
+		}
+	} else if (ok != NN_SOCKET && compress &&
+		   (!strncmp(buf, "500", 3) || !strncmp(buf, "501", 3)))
+		*status = NEWS_XOVER_UNSUPPORTED;
+	if (ok == NN_SOCKET)
+		goto end;
+
+	ov.cur = ov.mlist;
+	ov.header = NEWS_XHDR_TO;
+	ok = nntp_recv_status(session, NULL);
+	if (ok == NN_SUCCESS)
+		ok = nntp_recv_data(session, FALSE, news_xhdr_func, &ov);
+	else if (ok != NN_SOCKET)
+		log_warning(_("can't get xhdr\n"));
+	if (ok == NN_SOCKET)
+		goto end;
+
+	ov.cur = ov.mlist;
+	ov.header = NEWS_XHDR_CC;
+	ok = nntp_recv_status(session, NULL);
+	if (ok == NN_SUCCESS)
+		ok = nntp_recv_data(session, FALSE, news_xhdr_func, &ov);
+	else if (ok != NN_SOCKET)
+		log_warning(_("can't get xhdr\n"));
+
+end:
+	*mlist = ov.mlist;
+	return ok == NN_SOCKET ? NN_SOCKET : NN_SUCCESS;
 }
 
 #define PARSE_ONE_PARAM(p, srcp) \
@@ -25,6 +25,9 @@
 #include <glib/gi18n.h>
 #include <stdio.h>
 #include <string.h>
+#if HAVE_LIBZ
+#  include <zlib.h>
+#endif
 
 #include "nntp.h"
 #include "socket.h"
@@ -263,6 +266,191 @@ gint nntp_xhdr(NNTPSession *session, const gchar *header, gint first, gint last)
 	return NN_SUCCESS;
 }
 
+/* The following functions send commands without waiting for the
+   response so that several requests can be pipelined.  The responses
+   must be read later in the same order with nntp_recv_status() and
+   nntp_recv_data(). */
+
+gint nntp_xover_send(NNTPSession *session, gint first, gint last,
+		     gboolean compress)
+{
+	return nntp_gen_send(SESSION(session)->sock, "%s %d-%d",
+			     compress ? "XZVER" : "XOVER", first, last);
+}
+
+gint nntp_xhdr_send(NNTPSession *session, const gchar *header,
+		    gint first, gint last)
+{
+	return nntp_gen_send(SESSION(session)->sock, "XHDR %s %d-%d",
+			     header, first, last);
+}
+
+/* if argbuf is not NULL, the status line is stored to it even if the
+   command failed, so that the caller can check the reply code */
+gint nntp_recv_status(NNTPSession *session, gchar *argbuf)
+{
+	gint ok;
+
+	ok = nntp_ok(SESSION(session)->sock, argbuf);
+	session_set_access_time(SESSION(session));
+
+	return ok;
+}
+
+static gboolean nntp_is_data_end(const gchar *buf)
+{
+	return (buf[0] == '.' &&
+		(buf[1] == '\r' || buf[1] == '\n' || buf[1] == '\0'));
+}
+
+#if HAVE_LIBZ
+/* decode one line of yEnc data */
+static gint nntp_ydecode(const gchar *src, guchar *dest)
+{
+	guchar *p = dest;
+
+	for (; *src != '\0' && *src != '\r' && *src != '\n'; src++) {
+		if (*src == '=') {
+			if (*++src == '\0')
+				break;
+			*p++ = (guchar)(*src - 64 - 42);
+		} else
+			*p++ = (guchar)(*src - 42);
+	}
+
+	return p - dest;
+}
+
+static void nntp_split_lines(const guchar *data, gint len, GString *line,
+			     NNTPRecvFunc func, gpointer func_data)
+{
+	const guchar *p = data;
+	const guchar *end = data + len;
+	const guchar *nl;
+
+	while (p < end) {
+		nl = memchr(p, '\n', end - p);
+		if (!nl) {
+			g_string_append_len(line, (const gchar *)p, end - p);
+			break;
+		}
+		g_string_append_len(line, (const gchar *)p, nl - p);
+		if (line->len > 0 && line->str[line->len - 1] == '\r')
+			g_string_truncate(line, line->len - 1);
+		func(line->str, func_data);
+		g_string_truncate(line, 0);
+		p = nl + 1;
+	}
+}
+
+/* XZVER: the overview is deflated and yEnc encoded */
+static gint nntp_recv_compressed_data(NNTPSession *session,
+				      NNTPRecvFunc func, gpointer data)
+{
+	gchar buf[NNTPBUFSIZE];
+	guchar dec[NNTPBUFSIZE];
+	guchar out[NNTPBUFSIZE];
+	z_stream zs;
+	GString *line;
+	gchar *p;
+	gint ok = NN_SUCCESS;
+	gboolean done = FALSE;
+	gint r;
+
+	memset(&zs, 0, sizeof(zs));
+	if (inflateInit2(&zs, -MAX_WBITS) != Z_OK) {
+		g_warning("nntp_recv_compressed_data: inflateInit2() failed\n");
+		ok = NN_IOERR;
+		done = TRUE;
+	}
+
+	line = g_string_new(NULL);
+
+	for (;;) {
+		if (sock_gets(SESSION(session)->sock, buf, sizeof(buf)) < 0) {
+			ok = NN_SOCKET;
+			break;
+		}
+		if (nntp_is_data_end(buf))
+			break;
+
+		/* read until the end of data even after an error */
+		if (done)
+			continue;
+
+		p = buf;
+		if (*p == '.')
+			p++;
+		if (!strncmp(p, "=ybegin", 7) || !strncmp(p, "=ypart", 6) ||
+		    !strncmp(p, "=yend", 5))
+			continue;
+
+		zs.next_in = dec;
+		zs.avail_in = nntp_ydecode(p, dec);
+
+		do {
+			zs.next_out = out;
+			zs.avail_out = sizeof(out);
+			r = inflate(&zs, Z_NO_FLUSH);
+			if (r != Z_OK && r != Z_STREAM_END && r != Z_BUF_ERROR) {
+				g_warning("nntp_recv_compressed_data: "
+					  "inflate() failed: %d\n", r);
+				ok = NN_IOERR;
+				done = TRUE;
+				break;
+			}
+			nntp_split_lines(out, sizeof(out) - zs.avail_out, line,
+					 func, data);
+			if (r == Z_STREAM_END) {
+				done = TRUE;
+				break;
+			}
+		} while (zs.avail_out == 0);
+	}
+
+	if (ok == NN_SUCCESS && line->len > 0)
+		func(line->str, data);
+
+	g_string_free(line, TRUE);
+	inflateEnd(&zs);
+
+	return ok;
+}
+#endif /* HAVE_LIBZ */
+
+/* read multi-line data block and call func for each line (without the
+   trailing CRLF) */
+gint nntp_recv_data(NNTPSession *session, gboolean compressed,
+		    NNTPRecvFunc func, gpointer data)
+{
+	gchar buf[NNTPBUFSIZE];
+	gint ok = NN_SUCCESS;
+
+	g_return_val_if_fail(session != NULL, NN_ERROR);
+	g_return_val_if_fail(func != NULL, NN_ERROR);
+
+#if HAVE_LIBZ
+	if (compressed)
+		ok = nntp_recv_compressed_data(session, func, data);
+	else
+#endif
+	for (;;) {
+		if (sock_gets(SESSION(session)->sock, buf, sizeof(buf)) < 0) {
+			ok = NN_SOCKET;
+			break;
+		}
+		if (nntp_is_data_end(buf))
+			break;
+
+		strretchomp(buf);
+		func(buf[0] == '.' ? buf + 1 : buf, data);
+	}
+
+	session_set_access_time(SESSION(session));
+
+	return ok;
+}
+
 gint nntp_list(NNTPSession *session)
 {
 	return nntp_gen_command(session, NULL, "LIST");
@@ -324,11 +512,11 @@ static gint nntp_ok(SockInfo *sock, gchar *argbuf)
 		if (strlen(buf) < 3)
 			return NN_ERROR;
 
+		if (argbuf)
+			strcpy(argbuf, buf);
+
 		if ((buf[0] == '1' || buf[0] == '2' || buf[0] == '3') &&
 		    (buf[3] == ' ' || buf[3] == '\0')) {
-			if (argbuf)
-				strcpy(argbuf, buf);
-
 			if (!strncmp(buf, "381", 3))
 				return NN_AUTHCONT;
 
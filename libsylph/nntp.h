@@ -27,6 +27,9 @@
 
 typedef struct _NNTPSession	NNTPSession;
 
+typedef void (*NNTPRecvFunc)	(const gchar	*line,
+				 gpointer	 data);
+
 #define NNTP_SESSION(obj)       ((NNTPSession *)obj)
 
 struct _NNTPSession
@@ -38,6 +41,9 @@ struct _NNTPSession
 	gchar *userid;
 	gchar *passwd;
 	gboolean auth_failed;
+
+	/* server does not support compressed overview (XZVER) */
+	gboolean xzver_failed;
 };
 
 #define NN_SUCCESS	0
@@ -98,6 +104,20 @@ gint nntp_xhdr			(NNTPSession	*session,
 				 const gchar	*header,
 				 gint		 first,
 				 gint		 last);
+gint nntp_xover_send		(NNTPSession	*session,
+				 gint		 first,
+				 gint		 last,
+				 gboolean	 compress);
+gint nntp_xhdr_send		(NNTPSession	*session,
+				 const gchar	*header,
+				 gint		 first,
+				 gint		 last);
+gint nntp_recv_status		(NNTPSession	*session,
+				 gchar		*argbuf);
+gint nntp_recv_data		(NNTPSession	*session,
+				 gboolean	 compressed,
+				 NNTPRecvFunc	 func,
+				 gpointer	 data);
 gint nntp_list			(NNTPSession	*session);
 gint nntp_post			(NNTPSession	*session,
 				 FILE		*fp);
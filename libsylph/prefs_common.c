@@ -496,6 +496,8 @@ static PrefParam param[] = {
 	{"strict_cache_check", "FALSE", &prefs_common.strict_cache_check,
 	 P_BOOL},
 	{"io_timeout_secs", "60", &prefs_common.io_timeout_secs, P_INT},
+	{"smtp_max_connections", "2", &prefs_common.smtp_max_connections,
+	 P_INT},
 
 	{NULL, NULL, NULL, P_OTHER}
 };
@@ -330,6 +330,8 @@ struct _PrefsCommon
 	gint addressbook_col_name;
 	gint addressbook_col_addr;
 	gint addressbook_col_rem;
+
+	gint smtp_max_connections;           /* Advanced */
 };
 
 extern PrefsCommon prefs_common;
@@ -38,6 +38,20 @@
 
 #define BUFFSIZE	8192
 
+#define DECODE_CACHE_SIZE	1024
+
+#if USE_THREADS
+G_LOCK_DEFINE_STATIC(decode_cache);
+#define S_LOCK(name)	G_LOCK(name)
+#define S_UNLOCK(name)	G_UNLOCK(name)
+#else
+#define S_LOCK(name)
+#define S_UNLOCK(name)
+#endif
+
+/* raw header value -> decoded value */
+static GHashTable *decode_cache = NULL;
+
 gint procheader_get_one_field(gchar *buf, size_t len, FILE *fp,
 			      HeaderEntry hentry[])
 {
@@ -278,6 +292,65 @@ GSList *procheader_get_header_list_from_msginfo(MsgInfo *msginfo)
 	return hlist;
 }
 
+/* Returns the headers in the summary cache plus every occurrence of the
+   given headers read from the message file. Only those headers are
+   decoded, so this is much cheaper than reading the whole header. */
+GSList *procheader_get_header_list_from_msginfo_full(MsgInfo *msginfo,
+						     gchar **names)
+{
+	GSList *hlist;
+	HeaderEntry *hentry;
+	gchar buf[BUFFSIZE];
+	gchar *file;
+	FILE *fp = NULL;
+	gint i, n, hnum;
+
+	g_return_val_if_fail(msginfo != NULL, NULL);
+
+	hlist = procheader_get_header_list_from_msginfo(msginfo);
+	if (!names || !names[0])
+		return hlist;
+
+	for (n = 0; names[n] != NULL; n++)
+		;
+	hentry = g_new0(HeaderEntry, n + 1);
+	for (i = 0, n = 0; names[i] != NULL; i++) {
+		/* already held in MsgInfo */
+		if (msginfo->cc && !g_ascii_strcasecmp(names[i], "Cc"))
+			continue;
+		hentry[n].name = g_strconcat(names[i], ":", NULL);
+		hentry[n].unfold = TRUE;
+		n++;
+	}
+
+	if (n > 0 && (file = procmsg_get_message_file(msginfo)) != NULL) {
+		if ((fp = g_fopen(file, "rb")) == NULL)
+			FILE_OP_ERROR(file, "fopen");
+		g_free(file);
+	}
+	if (fp) {
+		while ((hnum = procheader_get_one_field(buf, sizeof(buf), fp,
+							hentry)) != -1) {
+			gchar *p = buf + strlen(hentry[hnum].name);
+			Header *header;
+
+			while (*p == ' ' || *p == '\t') p++;
+			header = g_new(Header, 1);
+			header->name = g_strndup(hentry[hnum].name,
+						 strlen(hentry[hnum].name) - 1);
+			header->body = conv_unmime_header(p, NULL);
+			hlist = g_slist_append(hlist, header);
+		}
+		fclose(fp);
+	}
+
+	for (i = 0; i < n; i++)
+		g_free(hentry[i].name);
+	g_free(hentry);
+
+	return hlist;
+}
+
 GSList *procheader_add_header_list(GSList *hlist, const gchar *header_name,
 				  const gchar *body)
 {
@@ -575,59 +648,242 @@ enum
 	H_X_FACE	= 11
 };
 
+/* returns H_* for the header name, or -1 if it is not used */
+static gint procheader_get_header_num(const gchar *name, gint len,
+				      gboolean full)
+{
+#define NAME_IS(str)	(!g_ascii_strncasecmp(name, str, len))
+
+	switch (len) {
+	case 2:
+		if (NAME_IS("To"))
+			return H_TO;
+		if (full && NAME_IS("Cc"))
+			return H_CC;
+		break;
+	case 4:
+		switch (g_ascii_tolower(name[0])) {
+		case 'd':
+			if (NAME_IS("Date"))
+				return H_DATE;
+			break;
+		case 'f':
+			if (NAME_IS("From"))
+				return H_FROM;
+			break;
+		case 's':
+			if (NAME_IS("Seen"))
+				return H_SEEN;
+			break;
+		}
+		break;
+	case 6:
+		if (full && NAME_IS("X-Face"))
+			return H_X_FACE;
+		break;
+	case 7:
+		if (NAME_IS("Subject"))
+			return H_SUBJECT;
+		break;
+	case 10:
+		switch (g_ascii_tolower(name[0])) {
+		case 'm':
+			if (NAME_IS("Message-Id"))
+				return H_MSG_ID;
+			break;
+		case 'n':
+			if (NAME_IS("Newsgroups"))
+				return H_NEWSGROUPS;
+			break;
+		case 'r':
+			if (NAME_IS("References"))
+				return H_REFERENCES;
+			break;
+		}
+		break;
+	case 11:
+		if (NAME_IS("In-Reply-To"))
+			return H_IN_REPLY_TO;
+		break;
+	case 12:
+		if (NAME_IS("Content-Type"))
+			return H_CONTENT_TYPE;
+		break;
+	default:
+		break;
+	}
+
+	return -1;
+
+#undef NAME_IS
+}
+
+/* returns the start of the next header field */
+static gchar *procheader_get_field_end(gchar *p)
+{
+	gchar *nl;
+
+	for (;;) {
+		if ((nl = strchr(p, '\n')) == NULL)
+			return p + strlen(p);
+		p = nl + 1;
+		if (*p != ' ' && *p != '\t')
+			return p;
+	}
+}
+
+/* terminate the field body [p, end) in place, unfolding it if required,
+   and return it without the leading white spaces */
+static gchar *procheader_get_field_body(gchar *p, gchar *end, gboolean unfold)
+{
+	gchar *r, *w;
+
+	while (end > p && (*(end - 1) == '\n' || *(end - 1) == '\r'))
+		end--;
+
+	if (unfold) {
+		/* replace each line break and the following white spaces
+		   with a single space */
+		for (r = w = p; r < end; r++) {
+			if (*r == '\r' && r + 1 < end && *(r + 1) == '\n')
+				continue;
+			if (*r == '\n') {
+				*w++ = ' ';
+				while (r + 1 < end &&
+				       (*(r + 1) == ' ' || *(r + 1) == '\t'))
+					r++;
+			} else
+				*w++ = *r;
+		}
+		end = w;
+	}
+	*end = '\0';
+
+	while (*p == ' ' || *p == '\t') p++;
+
+	return p;
+}
+
+/* read the header block (up to the first empty line) at once */
+static gchar *procheader_read_header_block(FILE *fp)
+{
+	GString *str;
+	gchar buf[BUFFSIZE];
+	gboolean line_head = TRUE;
+	size_t len;
+
+	str = g_string_sized_new(BUFFSIZE);
+
+	while (fgets(buf, sizeof(buf), fp) != NULL) {
+		if (line_head && (buf[0] == '\r' || buf[0] == '\n'))
+			break;
+		len = strlen(buf);
+		g_string_append_len(str, buf, len);
+		line_head = (len > 0 && buf[len - 1] == '\n');
+	}
+
+	return g_string_free(str, FALSE);
+}
+
+/* decode the MIME encoded words and the raw 8-bit characters in the
+   header value. The same From: and To: values appear many times in a
+   folder, so the decoded values are kept in a small cache. */
+static gchar *procheader_decode_header(const gchar *str,
+				       const gchar *charset)
+{
+	gchar *key;
+	gchar *decoded;
+
+	if (is_ascii_str(str) && !strstr(str, "=?")) {
+		decoded = g_strdup(str);
+		subst_control(decoded, ' ');
+		return decoded;
+	}
+
+	key = g_strconcat(charset ? charset : "", "\n", str, NULL);
+
+	S_LOCK(decode_cache);
+	if (decode_cache &&
+	    (decoded = g_hash_table_lookup(decode_cache, key)) != NULL) {
+		decoded = g_strdup(decoded);
+		S_UNLOCK(decode_cache);
+		g_free(key);
+		return decoded;
+	}
+	S_UNLOCK(decode_cache);
+
+	decoded = conv_unmime_header(str, charset);
+	subst_control(decoded, ' ');
+
+	S_LOCK(decode_cache);
+	if (decode_cache &&
+	    g_hash_table_size(decode_cache) >= DECODE_CACHE_SIZE) {
+		g_hash_table_destroy(decode_cache);
+		decode_cache = NULL;
+	}
+	if (!decode_cache)
+		decode_cache = g_hash_table_new_full(g_str_hash, g_str_equal,
+						     g_free, g_free);
+	g_hash_table_replace(decode_cache, key, g_strdup(decoded));
+	S_UNLOCK(decode_cache);
+
+	return decoded;
+}
+
 MsgInfo *procheader_parse_stream(FILE *fp, MsgFlags flags, gboolean full)
 {
-	static HeaderEntry hentry_full[] = {{"Date:",		NULL, FALSE},
-					   {"From:",		NULL, TRUE},
-					   {"To:",		NULL, TRUE},
-					   {"Newsgroups:",	NULL, TRUE},
-					   {"Subject:",		NULL, TRUE},
-					   {"Message-Id:",	NULL, FALSE},
-					   {"References:",	NULL, FALSE},
-					   {"In-Reply-To:",	NULL, FALSE},
-					   {"Content-Type:",	NULL, FALSE},
-					   {"Seen:",		NULL, FALSE},
-					   {"Cc:",		NULL, TRUE},
-					   {"X-Face:",		NULL, FALSE},
-					   {NULL,		NULL, FALSE}};
-
-	static HeaderEntry hentry_short[] = {{"Date:",		NULL, FALSE},
-					    {"From:",		NULL, TRUE},
-					    {"To:",		NULL, TRUE},
-					    {"Newsgroups:",	NULL, TRUE},
-					    {"Subject:",	NULL, TRUE},
-					    {"Message-Id:",	NULL, FALSE},
-					    {"References:",	NULL, FALSE},
-					    {"In-Reply-To:",	NULL, FALSE},
-					    {"Content-Type:",	NULL, FALSE},
-					    {"Seen:",		NULL, FALSE},
-					    {NULL,		NULL, FALSE}};
+	static gboolean unfold_table[] = {FALSE,	/* Date: */
+					  TRUE,		/* From: */
+					  TRUE,		/* To: */
+					  TRUE,		/* Newsgroups: */
+					  TRUE,		/* Subject: */
+					  FALSE,	/* Message-Id: */
+					  FALSE,	/* References: */
+					  FALSE,	/* In-Reply-To: */
+					  FALSE,	/* Content-Type: */
+					  FALSE,	/* Seen: */
+					  TRUE,		/* Cc: */
+					  FALSE};	/* X-Face: */
 
 	MsgInfo *msginfo;
 	gchar buf[BUFFSIZE];
+	gchar *header;
+	gchar *field, *next, *name_end;
 	gchar *p;
 	gchar *hp;
-	HeaderEntry *hentry;
 	gint hnum;
-	gchar *from = NULL, *to = NULL, *subject = NULL, *cc = NULL;
+	const gchar *from = NULL, *subject = NULL;
+	gchar *to = NULL, *cc = NULL;
 	gchar *charset = NULL;
 
-	hentry = full ? hentry_full : hentry_short;
-
 	if (MSG_IS_QUEUED(flags)) {
 		while (fgets(buf, sizeof(buf), fp) != NULL)
 			if (buf[0] == '\r' || buf[0] == '\n') break;
 	}
 
+	header = procheader_read_header_block(fp);
+
 	msginfo = g_new0(MsgInfo, 1);
 	msginfo->flags = flags;
 	msginfo->references = NULL;
 	msginfo->inreplyto = NULL;
 
-	while ((hnum = procheader_get_one_field(buf, sizeof(buf), fp, hentry))
-	       != -1) {
-		hp = buf + strlen(hentry[hnum].name);
-		while (*hp == ' ' || *hp == '\t') hp++;
+	for (field = header; *field != '\0'; field = next) {
+		next = procheader_get_field_end(field);
+
+		for (name_end = field; name_end < next && *name_end != ':' &&
+		     *name_end != ' ' && *name_end != '\t' &&
+		     *name_end != '\r' && *name_end != '\n'; name_end++)
+			;
+		if (name_end == field || *name_end != ':')
+			continue;
+
+		hnum = procheader_get_header_num(field, name_end - field, full);
+		if (hnum < 0)
+			continue;
+
+		hp = procheader_get_field_body(name_end + 1, next,
+					       unfold_table[hnum]);
 
 		switch (hnum) {
 		case H_DATE:
@@ -638,7 +894,7 @@ MsgInfo *procheader_parse_stream(FILE *fp, MsgFlags flags, gboolean full)
 			break;
 		case H_FROM:
 			if (from) break;
-			from = g_strdup(hp);
+			from = hp;
 			break;
 		case H_TO:
 			if (to) {
@@ -655,11 +911,11 @@ MsgInfo *procheader_parse_stream(FILE *fp, MsgFlags flags, gboolean full)
 					g_strconcat(p, ",", hp, NULL);
 				g_free(p);
 			} else
-				msginfo->newsgroups = g_strdup(buf + 12);
+				msginfo->newsgroups = g_strdup(hp);
 			break;
 		case H_SUBJECT:
-			if (msginfo->subject) break;
-			subject = g_strdup(hp);
+			if (subject) break;
+			subject = hp;
 			break;
 		case H_MSG_ID:
 			if (msginfo->msgid) break;
@@ -714,28 +970,24 @@ MsgInfo *procheader_parse_stream(FILE *fp, MsgFlags flags, gboolean full)
 		}
 	}
 
+	/* from and subject point into the header block */
 	if (from) {
-		msginfo->from = conv_unmime_header(from, charset);
-		subst_control(msginfo->from, ' ');
+		msginfo->from = procheader_decode_header(from, charset);
 		msginfo->fromname = procheader_get_fromname(msginfo->from);
-		g_free(from);
 	}
 	if (to) {
-		msginfo->to = conv_unmime_header(to, charset);
-		subst_control(msginfo->to, ' ');
+		msginfo->to = procheader_decode_header(to, charset);
 		g_free(to);
 	}
-	if (subject) {
-		msginfo->subject = conv_unmime_header(subject, charset);
-		subst_control(msginfo->subject, ' ');
-		g_free(subject);
-	}
+	if (subject)
+		msginfo->subject = procheader_decode_header(subject, charset);
 	if (cc) {
-		msginfo->cc = conv_unmime_header(cc, charset);
-		subst_control(msginfo->cc, ' ');
+		msginfo->cc = procheader_decode_header(cc, charset);
 		g_free(cc);
 	}
 
+	g_free(header);
+
 	if (!msginfo->inreplyto && msginfo->references)
 		msginfo->inreplyto =
 			g_strdup((gchar *)msginfo->references->data);
@@ -800,72 +1052,167 @@ gchar *procheader_get_toname(const gchar *str)
 	return g_string_free(toname, FALSE);
 }
 
+#define IS_DATE_SPACE(c)	((c) == ' ' || (c) == '\t' || \
+				 (c) == '\r' || (c) == '\n')
+
+static const gchar *procheader_date_skip_space(const gchar *p)
+{
+	while (IS_DATE_SPACE(*p)) p++;
+	return p;
+}
+
+/* read at most maxlen digits (any number if maxlen is 0) */
+static const gchar *procheader_date_get_num(const gchar *p, gint maxlen,
+					    gint *num)
+{
+	const gchar *start = p;
+	gint n = 0;
+
+	while (g_ascii_isdigit(*p) && (maxlen == 0 || p - start < maxlen)) {
+		n = n * 10 + (*p - '0');
+		p++;
+	}
+	if (p == start)
+		return NULL;
+
+	*num = n;
+	return p;
+}
+
+static gint procheader_date_get_month(const gchar *p)
+{
+	switch (g_ascii_tolower(p[0])) {
+	case 'j':
+		if (!g_ascii_strncasecmp(p, "Jan", 3)) return 1;
+		if (!g_ascii_strncasecmp(p, "Jun", 3)) return 6;
+		if (!g_ascii_strncasecmp(p, "Jul", 3)) return 7;
+		break;
+	case 'f':
+		if (!g_ascii_strncasecmp(p, "Feb", 3)) return 2;
+		break;
+	case 'm':
+		if (!g_ascii_strncasecmp(p, "Mar", 3)) return 3;
+		if (!g_ascii_strncasecmp(p, "May", 3)) return 5;
+		break;
+	case 'a':
+		if (!g_ascii_strncasecmp(p, "Apr", 3)) return 4;
+		if (!g_ascii_strncasecmp(p, "Aug", 3)) return 8;
+		break;
+	case 's':
+		if (!g_ascii_strncasecmp(p, "Sep", 3)) return 9;
+		break;
+	case 'o':
+		if (!g_ascii_strncasecmp(p, "Oct", 3)) return 10;
+		break;
+	case 'n':
+		if (!g_ascii_strncasecmp(p, "Nov", 3)) return 11;
+		break;
+	case 'd':
+		if (!g_ascii_strncasecmp(p, "Dec", 3)) return 12;
+		break;
+	}
+
+	return G_DATE_BAD_MONTH;
+}
+
+/* Scans "[Weekday[,]] DD Mon YYYY HH:MM[:SS] [Zone]" in one pass.
+   The month is returned as 1 - 12 (0 if unknown) and the zone is
+   copied to zone (at most 5 characters, empty if none). */
 static gint procheader_scan_date_string(const gchar *str,
-					gchar *weekday, gint *day,
-					gchar *month, gint *year,
+					gint *day, gint *month, gint *year,
 					gint *hh, gint *mm, gint *ss,
 					gchar *zone)
 {
-	gint result;
+	const gchar *p = str;
+	gint i;
 
-	result = sscanf(str, "%10s %d %9s %d %2d:%2d:%2d %5s",
-			weekday, day, month, year, hh, mm, ss, zone);
-	if (result == 8) return 0;
+	p = procheader_date_skip_space(p);
 
-	result = sscanf(str, "%3s,%d %9s %d %2d:%2d:%2d %5s",
-			weekday, day, month, year, hh, mm, ss, zone);
-	if (result == 8) return 0;
+	/* weekday */
+	if (!g_ascii_isdigit(*p)) {
+		while (*p != '\0' && *p != ',' && !IS_DATE_SPACE(*p))
+			p++;
+		if (*p == ',')
+			p++;
+		p = procheader_date_skip_space(p);
+	}
 
-	result = sscanf(str, "%d %9s %d %2d:%2d:%2d %5s",
-			day, month, year, hh, mm, ss, zone);
-	if (result == 7) return 0;
+	if ((p = procheader_date_get_num(p, 0, day)) == NULL)
+		return -1;
+	p = procheader_date_skip_space(p);
+
+	if (*p == '\0')
+		return -1;
+	*month = procheader_date_get_month(p);
+	while (*p != '\0' && !IS_DATE_SPACE(*p))
+		p++;
+	p = procheader_date_skip_space(p);
+
+	if ((p = procheader_date_get_num(p, 0, year)) == NULL)
+		return -1;
+	p = procheader_date_skip_space(p);
+
+	if ((p = procheader_date_get_num(p, 2, hh)) == NULL || *p != ':')
+		return -1;
+	if ((p = procheader_date_get_num(p + 1, 2, mm)) == NULL)
+		return -1;
+	*ss = 0;
+	if (*p == ':' && g_ascii_isdigit(*(p + 1)))
+		p = procheader_date_get_num(p + 1, 2, ss);
 
-	*zone = '\0';
-	result = sscanf(str, "%10s %d %9s %d %2d:%2d:%2d",
-			weekday, day, month, year, hh, mm, ss);
-	if (result == 7) return 0;
+	p = procheader_date_skip_space(p);
+	for (i = 0; i < 5 && *p != '\0' && !IS_DATE_SPACE(*p); i++)
+		zone[i] = *p++;
+	zone[i] = '\0';
 
-	result = sscanf(str, "%d %9s %d %2d:%2d:%2d",
-			day, month, year, hh, mm, ss);
-	if (result == 6) return 0;
+	return 0;
+}
 
-	*ss = 0;
-	result = sscanf(str, "%10s %d %9s %d %2d:%2d %5s",
-			weekday, day, month, year, hh, mm, zone);
-	if (result == 7) return 0;
+#undef IS_DATE_SPACE
 
-	result = sscanf(str, "%d %9s %d %2d:%2d %5s",
-			day, month, year, hh, mm, zone);
-	if (result == 6) return 0;
+/* days since 1970-01-01 of the proleptic Gregorian calendar date */
+static glong procheader_days_from_civil(gint y, gint m, gint d)
+{
+	glong era;
+	gint yoe, doy, doe;
 
-	*zone = '\0';
-	result = sscanf(str, "%10s %d %9s %d %2d:%2d",
-			weekday, day, month, year, hh, mm);
-	if (result == 6) return 0;
+	y -= m <= 2;
+	era = (y >= 0 ? y : y - 399) / 400;
+	yoe = y - era * 400;
+	doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+	doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
 
-	result = sscanf(str, "%d %9s %d %2d:%2d",
-			day, month, year, hh, mm);
-	if (result == 5) return 0;
+	return era * 146097 + doe - 719468;
+}
 
-	return -1;
+/* returns -1 if the zone is unknown */
+static time_t procheader_get_zone_offset(const gchar *zone)
+{
+	time_t offset;
+
+	/* fast path for the numeric form */
+	if ((zone[0] == '+' || zone[0] == '-') &&
+	    g_ascii_isdigit(zone[1]) && g_ascii_isdigit(zone[2]) &&
+	    g_ascii_isdigit(zone[3]) && g_ascii_isdigit(zone[4])) {
+		offset = ((zone[1] - '0') * 10 + (zone[2] - '0')) * 3600 +
+			((zone[3] - '0') * 10 + (zone[4] - '0')) * 60;
+		return zone[0] == '-' ? -offset : offset;
+	}
+
+	return remote_tzoffset_sec(zone);
 }
 
 time_t procheader_date_parse(gchar *dest, const gchar *src, gint len)
 {
-	static gchar monthstr[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
-	gchar weekday[11];
 	gint day;
-	gchar month[10];
+	gint month;
 	gint year;
 	gint hh, mm, ss;
 	gchar zone[6];
-	GDateMonth dmonth = G_DATE_BAD_MONTH;
-	struct tm t;
-	gchar *p;
 	time_t timer;
 	time_t tz_offset;
 
-	if (procheader_scan_date_string(src, weekday, &day, month, &year,
+	if (procheader_scan_date_string(src, &day, &month, &year,
 					&hh, &mm, &ss, zone) < 0) {
 		if (dest && len > 0)
 			strncpy2(dest, src, len);
@@ -880,35 +1227,40 @@ time_t procheader_date_parse(gchar *dest, const gchar *src, gint len)
 			year += 1900;
 	}
 
-	month[3] = '\0';
-	for (p = monthstr; *p != '\0'; p += 3) {
-		if (!g_ascii_strncasecmp(p, month, 3)) {
-			dmonth = (gint)(p - monthstr) / 3 + 1;
-			break;
-		}
-	}
+	tz_offset = procheader_get_zone_offset(zone);
 
-	t.tm_sec = ss;
-	t.tm_min = mm;
-	t.tm_hour = hh;
-	t.tm_mday = day;
-	t.tm_mon = dmonth - 1;
-	t.tm_year = year - 1900;
-	t.tm_wday = 0;
-	t.tm_yday = 0;
-	t.tm_isdst = -1;
-
-	timer = mktime(&t);
-	if (timer == -1) {
-		if (dest)
-			dest[0] = '\0';
-		return 0;
+	if (tz_offset != -1) {
+		/* compute UTC directly; no need for the local time zone */
+		if (month == G_DATE_BAD_MONTH) {
+			/* same as mktime() with tm_mon == -1 */
+			month = 12;
+			year--;
+		}
+		timer = (time_t)procheader_days_from_civil(year, month, 1) *
+			86400 + (time_t)(day - 1) * 86400 +
+			hh * 3600 + mm * 60 + ss - tz_offset;
+	} else {
+		struct tm t;
+
+		/* no zone: assume local time */
+		t.tm_sec = ss;
+		t.tm_min = mm;
+		t.tm_hour = hh;
+		t.tm_mday = day;
+		t.tm_mon = month - 1;
+		t.tm_year = year - 1900;
+		t.tm_wday = 0;
+		t.tm_yday = 0;
+		t.tm_isdst = -1;
+
+		timer = mktime(&t);
+		if (timer == -1) {
+			if (dest)
+				dest[0] = '\0';
+			return 0;
+		}
 	}
 
-	tz_offset = remote_tzoffset_sec(zone);
-	if (tz_offset != -1)
-		timer += tzoffset_sec(&timer) - tz_offset;
-
 	if (dest)
 		procheader_date_get_localtime(dest, len, timer);
 
@@ -32,6 +32,7 @@
 
 #include "procmime.h"
 #include "procheader.h"
+#include "folder.h"
 #include "base64.h"
 #include "quoted-printable.h"
 #include "uuencode.h"
@@ -42,6 +43,35 @@
 
 #define MAX_MIME_LEVEL	64
 
+/* maximum number of MIME cache entries per folder */
+#define MIME_CACHE_MAX_ENTRIES	4096
+
+#if USE_THREADS
+G_LOCK_DEFINE_STATIC(mime_cache);
+#define S_LOCK(name)	G_LOCK(name)
+#define S_UNLOCK(name)	G_UNLOCK(name)
+#else
+#define S_LOCK(name)
+#define S_UNLOCK(name)
+#endif
+
+typedef struct _MimeCacheEntry	MimeCacheEntry;
+
+struct _MimeCacheEntry
+{
+	gsize size;
+	time_t mtime;
+	MimeInfo *mimeinfo;
+	guint stamp;
+};
+
+/* incremented on every use of a cache entry */
+static guint mime_cache_stamp = 0;
+
+static MimeInfo *procmime_mime_cache_lookup	(MsgInfo	*msginfo);
+static void procmime_mime_cache_add		(MsgInfo	*msginfo,
+						 MimeInfo	*mimeinfo);
+
 static GHashTable *procmime_get_mime_type_table	(void);
 static GList *procmime_get_mime_type_list	(const gchar *file);
 
@@ -184,6 +214,9 @@ MimeInfo *procmime_scan_message(MsgInfo *msginfo)
 
 	g_return_val_if_fail(msginfo != NULL, NULL);
 
+	if ((mimeinfo = procmime_mime_cache_lookup(msginfo)) != NULL)
+		return mimeinfo;
+
 	if ((fp = procmsg_open_message_decrypted(msginfo, &mimeinfo)) == NULL)
 		return NULL;
 
@@ -199,12 +232,545 @@ MimeInfo *procmime_scan_message(MsgInfo *msginfo)
 
 	fclose(fp);
 
+	if (mimeinfo)
+		procmime_mime_cache_add(msginfo, mimeinfo);
+
+	return mimeinfo;
+}
+
+/* MIME structure cache */
+
+static MimeInfo *procmime_mimeinfo_copy(const MimeInfo *mimeinfo,
+					MimeInfo *parent, MimeInfo *main)
+{
+	MimeInfo *new_info;
+	MimeInfo *child, *new_child, *last = NULL;
+
+	new_info = procmime_mimeinfo_new();
+
+	new_info->encoding = g_strdup(mimeinfo->encoding);
+	new_info->encoding_type = mimeinfo->encoding_type;
+	new_info->mime_type = mimeinfo->mime_type;
+	new_info->content_type = g_strdup(mimeinfo->content_type);
+	new_info->charset = g_strdup(mimeinfo->charset);
+	new_info->name = g_strdup(mimeinfo->name);
+	new_info->boundary = g_strdup(mimeinfo->boundary);
+	new_info->content_disposition =
+		g_strdup(mimeinfo->content_disposition);
+	new_info->filename = g_strdup(mimeinfo->filename);
+	new_info->fpos = mimeinfo->fpos;
+	new_info->size = mimeinfo->size;
+	new_info->content_size = mimeinfo->content_size;
+	new_info->level = mimeinfo->level;
+	new_info->parent = parent;
+	new_info->main = main;
+
+	/* the sub part of message/rfc822 shares the parent */
+	if (mimeinfo->sub)
+		new_info->sub = procmime_mimeinfo_copy(mimeinfo->sub, parent,
+						       new_info);
+
+	for (child = mimeinfo->children; child != NULL; child = child->next) {
+		new_child = procmime_mimeinfo_copy(child, new_info, NULL);
+		if (last)
+			last->next = new_child;
+		else
+			new_info->children = new_child;
+		last = new_child;
+	}
+
+	return new_info;
+}
+
+static void procmime_write_mimeinfo(MimeInfo *mimeinfo, FILE *fp)
+{
+	MimeInfo *child;
+	gint n_children = 0;
+
+	WRITE_CACHE_DATA_INT(mimeinfo->encoding_type, fp);
+	WRITE_CACHE_DATA_INT(mimeinfo->mime_type, fp);
+	WRITE_CACHE_DATA_INT(mimeinfo->fpos, fp);
+	WRITE_CACHE_DATA_INT(mimeinfo->size, fp);
+	WRITE_CACHE_DATA_INT(mimeinfo->content_size, fp);
+	WRITE_CACHE_DATA_INT(mimeinfo->level, fp);
+
+	WRITE_CACHE_DATA(mimeinfo->encoding, fp);
+	WRITE_CACHE_DATA(mimeinfo->content_type, fp);
+	WRITE_CACHE_DATA(mimeinfo->charset, fp);
+	WRITE_CACHE_DATA(mimeinfo->name, fp);
+	WRITE_CACHE_DATA(mimeinfo->boundary, fp);
+	WRITE_CACHE_DATA(mimeinfo->content_disposition, fp);
+	WRITE_CACHE_DATA(mimeinfo->filename, fp);
+
+	WRITE_CACHE_DATA_INT(mimeinfo->sub ? 1 : 0, fp);
+	if (mimeinfo->sub)
+		procmime_write_mimeinfo(mimeinfo->sub, fp);
+
+	for (child = mimeinfo->children; child != NULL; child = child->next)
+		n_children++;
+	WRITE_CACHE_DATA_INT(n_children, fp);
+	for (child = mimeinfo->children; child != NULL; child = child->next)
+		procmime_write_mimeinfo(child, fp);
+}
+
+#define READ_MIME_CACHE_INT(n, fp)				\
+{								\
+	guint32 idata;						\
+								\
+	if (fread(&idata, sizeof(idata), 1, fp) != 1) {		\
+		procmime_mimeinfo_free_all(mimeinfo);		\
+		return NULL;					\
+	} else							\
+		n = idata;					\
+}
+
+#define READ_MIME_CACHE_STR(data, fp)				\
+{								\
+	if (procmsg_read_cache_data_str(fp, &data) < 0) {	\
+		procmime_mimeinfo_free_all(mimeinfo);		\
+		return NULL;					\
+	}							\
+}
+
+static MimeInfo *procmime_read_mimeinfo(FILE *fp, MimeInfo *parent,
+					MimeInfo *main, gint depth)
+{
+	MimeInfo *mimeinfo;
+	MimeInfo *child, *last = NULL;
+	guint32 has_sub, n_children, i;
+
+	if (depth > MAX_MIME_LEVEL * 2)
+		return NULL;
+
+	mimeinfo = procmime_mimeinfo_new();
+
+	READ_MIME_CACHE_INT(mimeinfo->encoding_type, fp);
+	READ_MIME_CACHE_INT(mimeinfo->mime_type, fp);
+	READ_MIME_CACHE_INT(mimeinfo->fpos, fp);
+	READ_MIME_CACHE_INT(mimeinfo->size, fp);
+	READ_MIME_CACHE_INT(mimeinfo->content_size, fp);
+	READ_MIME_CACHE_INT(mimeinfo->level, fp);
+
+	READ_MIME_CACHE_STR(mimeinfo->encoding, fp);
+	READ_MIME_CACHE_STR(mimeinfo->content_type, fp);
+	READ_MIME_CACHE_STR(mimeinfo->charset, fp);
+	READ_MIME_CACHE_STR(mimeinfo->name, fp);
+	READ_MIME_CACHE_STR(mimeinfo->boundary, fp);
+	READ_MIME_CACHE_STR(mimeinfo->content_disposition, fp);
+	READ_MIME_CACHE_STR(mimeinfo->filename, fp);
+
+	mimeinfo->parent = parent;
+	mimeinfo->main = main;
+
+	READ_MIME_CACHE_INT(has_sub, fp);
+	if (has_sub) {
+		mimeinfo->sub = procmime_read_mimeinfo(fp, parent, mimeinfo,
+						       depth + 1);
+		if (!mimeinfo->sub) {
+			procmime_mimeinfo_free_all(mimeinfo);
+			return NULL;
+		}
+	}
+
+	READ_MIME_CACHE_INT(n_children, fp);
+	for (i = 0; i < n_children; i++) {
+		child = procmime_read_mimeinfo(fp, mimeinfo, NULL, depth + 1);
+		if (!child) {
+			procmime_mimeinfo_free_all(mimeinfo);
+			return NULL;
+		}
+		if (last)
+			last->next = child;
+		else
+			mimeinfo->children = child;
+		last = child;
+	}
+
+	return mimeinfo;
+}
+
+#undef READ_MIME_CACHE_INT
+#undef READ_MIME_CACHE_STR
+
+static void procmime_mime_cache_entry_free(gpointer data)
+{
+	MimeCacheEntry *entry = (MimeCacheEntry *)data;
+
+	procmime_mimeinfo_free_all(entry->mimeinfo);
+	g_free(entry);
+}
+
+static void procmime_read_mime_cache(FolderItem *item)
+{
+	gchar *file;
+	FILE *fp;
+	gchar file_buf[BUFFSIZE];
+	guint32 num, size, mtime;
+	MimeCacheEntry *entry;
+	MimeInfo *mimeinfo;
+
+	item->mime_cache = g_hash_table_new_full
+		(NULL, g_direct_equal, NULL, procmime_mime_cache_entry_free);
+	item->mime_cache_dirty = FALSE;
+
+	file = folder_item_get_mime_cache_file(item);
+	fp = procmsg_open_data_file(file, MIME_CACHE_VERSION, DATA_READ,
+				    file_buf, sizeof(file_buf));
+	g_free(file);
+	if (!fp)
+		return;
+
+	debug_print("Reading MIME cache (%s)...\n", item->path);
+
+	while (fread(&num, sizeof(num), 1, fp) == 1) {
+		if (fread(&size, sizeof(size), 1, fp) != 1 ||
+		    fread(&mtime, sizeof(mtime), 1, fp) != 1 ||
+		    (mimeinfo = procmime_read_mimeinfo(fp, NULL, NULL, 0))
+		    == NULL) {
+			g_warning("MIME cache data is corrupted\n");
+			item->mime_cache_dirty = TRUE;
+			break;
+		}
+
+		entry = g_new(MimeCacheEntry, 1);
+		entry->size = size;
+		entry->mtime = mtime;
+		entry->mimeinfo = mimeinfo;
+		entry->stamp = ++mime_cache_stamp;
+		g_hash_table_replace(item->mime_cache, GUINT_TO_POINTER(num),
+				     entry);
+		if (g_hash_table_size(item->mime_cache) >=
+		    MIME_CACHE_MAX_ENTRIES) {
+			item->mime_cache_dirty = TRUE;
+			break;
+		}
+	}
+
+	fclose(fp);
+
+	debug_print("done. (%d entries)\n",
+		    g_hash_table_size(item->mime_cache));
+}
+
+static gboolean procmime_mime_cache_is_enabled(MsgInfo *msginfo)
+{
+	FolderItem *item = msginfo->folder;
+
+	if (!item || !item->path || item->stype == F_VIRTUAL)
+		return FALSE;
+	if (msginfo->msgnum == 0 || msginfo->file_path)
+		return FALSE;
+	/* the structure of decrypted messages depends on the plaintext */
+	if (MSG_IS_ENCRYPTED(msginfo->flags) || msginfo->encinfo)
+		return FALSE;
+
+	return TRUE;
+}
+
+static MimeInfo *procmime_mime_cache_lookup(MsgInfo *msginfo)
+{
+	MimeCacheEntry *entry;
+	MimeInfo *mimeinfo = NULL;
+
+	if (!procmime_mime_cache_is_enabled(msginfo))
+		return NULL;
+
+	S_LOCK(mime_cache);
+
+	if (!msginfo->folder->mime_cache)
+		procmime_read_mime_cache(msginfo->folder);
+
+	entry = g_hash_table_lookup(msginfo->folder->mime_cache,
+				    GUINT_TO_POINTER(msginfo->msgnum));
+	if (entry) {
+		if (entry->size != msginfo->size ||
+		    entry->mtime != msginfo->mtime) {
+			g_hash_table_remove(msginfo->folder->mime_cache,
+					    GUINT_TO_POINTER(msginfo->msgnum));
+			msginfo->folder->mime_cache_dirty = TRUE;
+		} else {
+			entry->stamp = ++mime_cache_stamp;
+			mimeinfo = procmime_mimeinfo_copy(entry->mimeinfo,
+							  NULL, NULL);
+		}
+	}
+
+	S_UNLOCK(mime_cache);
+
 	return mimeinfo;
 }
 
+static gboolean procmime_mime_cache_prune_func(gpointer key, gpointer value,
+					       gpointer data)
+{
+	MimeCacheEntry *entry = (MimeCacheEntry *)value;
+
+	return mime_cache_stamp - entry->stamp > MIME_CACHE_MAX_ENTRIES / 2;
+}
+
+static void procmime_mime_cache_add(MsgInfo *msginfo, MimeInfo *mimeinfo)
+{
+	MimeCacheEntry *entry;
+
+	if (!procmime_mime_cache_is_enabled(msginfo))
+		return;
+	if (mimeinfo->content_type &&
+	    !g_ascii_strcasecmp(mimeinfo->content_type, "multipart/encrypted"))
+		return;
+
+	S_LOCK(mime_cache);
+
+	if (!msginfo->folder->mime_cache)
+		procmime_read_mime_cache(msginfo->folder);
+
+	/* drop the entries not used recently (at least a half of them) */
+	if (g_hash_table_size(msginfo->folder->mime_cache) >=
+	    MIME_CACHE_MAX_ENTRIES) {
+		g_hash_table_foreach_remove(msginfo->folder->mime_cache,
+					    procmime_mime_cache_prune_func,
+					    NULL);
+		debug_print("MIME cache pruned (%d entries)\n",
+			    g_hash_table_size(msginfo->folder->mime_cache));
+	}
+
+	entry = g_new(MimeCacheEntry, 1);
+	entry->size = msginfo->size;
+	entry->mtime = msginfo->mtime;
+	entry->mimeinfo = procmime_mimeinfo_copy(mimeinfo, NULL, NULL);
+	entry->stamp = ++mime_cache_stamp;
+	g_hash_table_replace(msginfo->folder->mime_cache,
+			     GUINT_TO_POINTER(msginfo->msgnum), entry);
+	msginfo->folder->mime_cache_dirty = TRUE;
+
+	S_UNLOCK(mime_cache);
+}
+
+static void procmime_write_mime_cache_func(gpointer key, gpointer value,
+					   gpointer data)
+{
+	MimeCacheEntry *entry = (MimeCacheEntry *)value;
+	FILE *fp = (FILE *)data;
+
+	WRITE_CACHE_DATA_INT(GPOINTER_TO_UINT(key), fp);
+	WRITE_CACHE_DATA_INT(entry->size, fp);
+	WRITE_CACHE_DATA_INT(entry->mtime, fp);
+	procmime_write_mimeinfo(entry->mimeinfo, fp);
+}
+
+static gboolean procmime_mime_cache_remove_func(gpointer key, gpointer value,
+						gpointer data)
+{
+	MimeCacheEntry *entry = (MimeCacheEntry *)value;
+	GHashTable *msg_table = (GHashTable *)data;
+	MsgInfo *msginfo;
+
+	msginfo = g_hash_table_lookup(msg_table, key);
+	if (!msginfo || msginfo->size != entry->size ||
+	    msginfo->mtime != entry->mtime)
+		return TRUE;
+
+	return FALSE;
+}
+
+/* write the MIME structure cache of item if it was modified. If mlist is
+   given, the entries of messages not in mlist are removed. */
+void procmime_write_mime_cache(FolderItem *item, GSList *mlist)
+{
+	gchar *file;
+	FILE *fp;
+	gchar file_buf[BUFFSIZE];
+
+	g_return_if_fail(item != NULL);
+
+	S_LOCK(mime_cache);
+
+	if (!item->mime_cache || !item->path) {
+		S_UNLOCK(mime_cache);
+		return;
+	}
+
+	if (mlist) {
+		GHashTable *msg_table;
+
+		msg_table = procmsg_msg_hash_table_create(mlist);
+		if (g_hash_table_foreach_remove(item->mime_cache,
+						procmime_mime_cache_remove_func,
+						msg_table) > 0)
+			item->mime_cache_dirty = TRUE;
+		g_hash_table_destroy(msg_table);
+	}
+
+	if (!item->mime_cache_dirty) {
+		S_UNLOCK(mime_cache);
+		return;
+	}
+
+	debug_print("Writing MIME cache (%s)\n", item->path);
+
+	file = folder_item_get_mime_cache_file(item);
+	fp = procmsg_open_data_file(file, MIME_CACHE_VERSION, DATA_WRITE,
+				    file_buf, sizeof(file_buf));
+	g_free(file);
+	if (!fp) {
+		S_UNLOCK(mime_cache);
+		return;
+	}
+
+	g_hash_table_foreach(item->mime_cache, procmime_write_mime_cache_func,
+			     fp);
+	if (fclose(fp) == EOF)
+		FILE_OP_ERROR(item->path, "fclose");
+
+	item->mime_cache_dirty = FALSE;
+
+	S_UNLOCK(mime_cache);
+}
+
+static gboolean procmime_write_mime_cache_node_func(GNode *node,
+						    gpointer data)
+{
+	FolderItem *item = FOLDER_ITEM(node->data);
+
+	if (item->mime_cache_dirty)
+		procmime_write_mime_cache(item, NULL);
+
+	return FALSE;
+}
+
+void procmime_write_all_mime_caches(void)
+{
+	GList *list;
+	Folder *folder;
+
+	for (list = folder_get_list(); list != NULL; list = list->next) {
+		folder = FOLDER(list->data);
+		g_node_traverse(folder->node, G_PRE_ORDER, G_TRAVERSE_ALL, -1,
+				procmime_write_mime_cache_node_func, NULL);
+	}
+}
+
+#define BOUNDARY_SCAN_BUFSIZE	65536
+
+static void procmime_count_base64(const gchar *p, const gchar *end,
+				  guint *content_len, gint *pad_len)
+{
+	const gchar *s, *nl;
+	guint len = 0;
+	gint pad = 0;
+
+	for (s = p; s < end; s = nl + 1) {
+		if ((nl = memchr(s, '\n', end - s)) == NULL)
+			nl = end;
+		len += nl - s;
+		if (nl > s && nl[-1] == '\r')
+			len--;
+	}
+	for (s = p; (s = memchr(s, '=', end - s)) != NULL; s++)
+		pad++;
+
+	*content_len += len;
+	*pad_len += pad;
+}
+
+/* search the boundary line from the current position of fp. Instead of
+   reading the file line by line, read it in large blocks and only look at
+   the line starts which begin with '-'.
+   If found, the boundary line is copied to buf (at most BUFFSIZE - 1
+   bytes) and fp is positioned just after it. Otherwise buf is set to ""
+   and fp is at the end of file.
+   If b64_content_len is not NULL, the number of base64 characters and
+   pad characters before the boundary are added to it and b64_pad_len. */
+static gboolean procmime_find_boundary(FILE *fp, const gchar *boundary,
+				       gint boundary_len, gchar *buf,
+				       guint *b64_content_len,
+				       gint *b64_pad_len)
+{
+	gchar *block;
+	glong block_pos;
+	gint len = 0, n;
+	gboolean line_start = TRUE;
+	gboolean eof = FALSE;
+	gboolean found = FALSE;
+
+	buf[0] = '\0';
+
+	if ((block_pos = ftell(fp)) < 0) {
+		perror("ftell");
+		return FALSE;
+	}
+
+	block = g_malloc(BOUNDARY_SCAN_BUFSIZE);
+
+	while (!found && !eof) {
+		const gchar *p, *q, *end, *scan_end, *nl;
+		gint carry;
+
+		n = fread(block + len, 1, BOUNDARY_SCAN_BUFSIZE - len, fp);
+		if (n < BOUNDARY_SCAN_BUFSIZE - len)
+			eof = TRUE;
+		len += n;
+		end = block + len;
+
+		/* a line start in the last bytes may be completed by the
+		   next block */
+		if (eof || !boundary)
+			scan_end = end;
+		else if (len > boundary_len + 2)
+			scan_end = end - (boundary_len + 2);
+		else
+			scan_end = block;
+
+		p = block;
+		while (boundary && p < scan_end &&
+		       (q = memchr(p, '-', scan_end - p)) != NULL) {
+			p = q + 1;
+			if (q == block ? !line_start : q[-1] != '\n')
+				continue;
+			if (end - q < boundary_len + 2 || q[1] != '-' ||
+			    memcmp(q + 2, boundary, boundary_len) != 0)
+				continue;
+
+			nl = memchr(q, '\n', end - q);
+			if (nl)
+				nl++;
+			else if (eof || q == block)
+				nl = end;
+			else {
+				/* read the rest of the boundary line */
+				scan_end = q;
+				break;
+			}
+
+			n = MIN(nl - q, BUFFSIZE - 1);
+			memcpy(buf, q, n);
+			buf[n] = '\0';
+			scan_end = q;
+			found = TRUE;
+			if (fseek(fp, block_pos + (nl - block), SEEK_SET) < 0)
+				perror("fseek");
+			break;
+		}
+
+		if (b64_content_len)
+			procmime_count_base64(block, scan_end, b64_content_len,
+					      b64_pad_len);
+
+		if (scan_end > block)
+			line_start = scan_end[-1] == '\n';
+		carry = end - scan_end;
+		if (carry > 0 && !found)
+			memmove(block, scan_end, carry);
+		block_pos += scan_end - block;
+		len = carry;
+	}
+
+	g_free(block);
+
+	return found;
+}
+
 void procmime_scan_multipart_message(MimeInfo *mimeinfo, FILE *fp)
 {
-	gchar *p;
 	gchar *boundary;
 	gint boundary_len = 0;
 	gchar *buf;
@@ -228,9 +794,8 @@ void procmime_scan_multipart_message(MimeInfo *mimeinfo, FILE *fp)
 		boundary_len = strlen(boundary);
 
 		/* look for first boundary */
-		while ((p = fgets(buf, BUFFSIZE, fp)) != NULL)
-			if (IS_BOUNDARY(buf, boundary, boundary_len)) break;
-		if (!p) {
+		if (!procmime_find_boundary(fp, boundary, boundary_len,
+					    buf, NULL, NULL)) {
 			g_free(buf);
 			return;
 		}
@@ -292,26 +857,15 @@ void procmime_scan_multipart_message(MimeInfo *mimeinfo, FILE *fp)
 		}
 
 		/* look for next boundary */
-		buf[0] = '\0';
 		is_base64 = partinfo->encoding_type == ENC_BASE64;
-		while ((p = fgets(buf, BUFFSIZE, fp)) != NULL) {
-			if (IS_BOUNDARY(buf, boundary, boundary_len)) {
-				if (buf[2 + boundary_len]     == '-' &&
-				    buf[2 + boundary_len + 1] == '-')
-					eom = TRUE;
-				break;
-			} else if (is_base64) {
-				const gchar *s;
-				for (s = buf; *s && *s != '\r' && *s != '\n';
-				     ++s)
-					if (*s == '=')
-						++b64_pad_len;
-				b64_content_len += s - buf;
-			}
-		}
-		if (p == NULL) {
+		if (procmime_find_boundary(fp, boundary, boundary_len, buf,
+					   is_base64 ? &b64_content_len : NULL,
+					   &b64_pad_len)) {
+			if (buf[2 + boundary_len]     == '-' &&
+			    buf[2 + boundary_len + 1] == '-')
+				eom = TRUE;
+		} else {
 			/* broken MIME, or single part MIME message */
-			buf[0] = '\0';
 			eom = TRUE;
 		}
 		debug_print("boundary: %s\n", buf);
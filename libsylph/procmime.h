@@ -145,6 +145,10 @@ MimeInfo *procmime_scan_message		(MsgInfo	*msginfo);
 void procmime_scan_multipart_message	(MimeInfo	*mimeinfo,
 					 FILE		*fp);
 
+void procmime_write_mime_cache		(FolderItem	*item,
+					 GSList		*mlist);
+void procmime_write_all_mime_caches	(void);
+
 /* scan headers */
 
 void procmime_scan_encoding		(MimeInfo	*mimeinfo,
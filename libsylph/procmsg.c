@@ -32,6 +32,7 @@
 #include "procmime.h"
 #include "prefs_common.h"
 #include "folder.h"
+#include "imap.h"
 #include "codeconv.h"
 
 typedef struct _MsgFlagInfo {
@@ -39,16 +40,35 @@ typedef struct _MsgFlagInfo {
 	MsgFlags flags;
 } MsgFlagInfo;
 
+/* The flags of the mark file, stored column-wise and sorted by the
+   message number. */
+typedef struct _MarkTable {
+	guint len;
+	guint32 *nums;
+	MsgPermFlags *flags;
+} MarkTable;
+
+typedef struct _MarkRecord {
+	guint32 num;
+	MsgPermFlags flags;
+	guint order;
+} MarkRecord;
+
 static GSList *procmsg_read_cache_queue		(FolderItem	*item,
 						 gboolean	 scan_file);
 
-static void mark_sum_func			(gpointer	 key,
-						 gpointer	 value,
-						 gpointer	 data);
+static MarkTable *mark_table_new		(GArray		*records);
+static void mark_table_free			(MarkTable	*table);
+static guint mark_table_lower_bound		(MarkTable	*table,
+						 guint		 num);
+static gint mark_table_lookup			(MarkTable	*table,
+						 guint		 num);
+static void mark_table_unset_flags		(MarkTable	*table,
+						 MsgPermFlags	 flags);
 
-static GHashTable *procmsg_read_mark_file	(FolderItem	*item);
+static MarkTable *procmsg_read_mark_file	(FolderItem	*item);
 static void procmsg_write_mark_file		(FolderItem	*item,
-						 GHashTable	*mark_table);
+						 MarkTable	*mark_table);
 
 static FILE *procmsg_open_cache_file_with_buffer(FolderItem	*item,
 						 DataOpenMode	 mode,
@@ -218,17 +238,6 @@ GSList *procmsg_read_cache(FolderItem *item, gboolean scan_file)
 		MSG_SET_TMP_FLAGS(default_flags, MSG_NEWS);
 	}
 
-	if (type == F_MH) {
-		gchar *path;
-
-		path = folder_item_get_path(item);
-		if (change_dir(path) < 0) {
-			g_free(path);
-			return NULL;
-		}
-		g_free(path);
-	}
-
 	if ((fp = procmsg_open_cache_file_with_buffer
 		(item, DATA_READ, file_buf, sizeof(file_buf))) == NULL) {
 		item->cache_dirty = TRUE;
@@ -350,11 +359,6 @@ static GSList *procmsg_read_cache_queue(FolderItem *item, gboolean scan_file)
 	return qlist;
 }
 
-static void mark_unset_new_func(gpointer key, gpointer value, gpointer data)
-{
-	MSG_UNSET_PERM_FLAGS(*((MsgFlags *)value), MSG_NEW);
-}
-
 void procmsg_set_flags(GSList *mlist, FolderItem *item)
 {
 	GSList *cur;
@@ -363,8 +367,8 @@ void procmsg_set_flags(GSList *mlist, FolderItem *item)
 	gint unflagged = 0;
 	gboolean mark_queue_exist;
 	MsgInfo *msginfo;
-	GHashTable *mark_table;
-	MsgFlags *flags;
+	MarkTable *mark_table;
+	gint i;
 
 	g_return_if_fail(item != NULL);
 	g_return_if_fail(item->folder != NULL);
@@ -384,11 +388,8 @@ void procmsg_set_flags(GSList *mlist, FolderItem *item)
 	if (!mark_queue_exist) {
 		for (cur = mlist; cur != NULL; cur = cur->next) {
 			msginfo = (MsgInfo *)cur->data;
-			flags = g_hash_table_lookup
-				(mark_table, GUINT_TO_POINTER(msginfo->msgnum));
-			if (!flags) {
-				g_hash_table_foreach(mark_table,
-						     mark_unset_new_func, NULL);
+			if (mark_table_lookup(mark_table, msginfo->msgnum) < 0) {
+				mark_table_unset_flags(mark_table, MSG_NEW);
 				item->mark_dirty = TRUE;
 				break;
 			}
@@ -401,15 +402,14 @@ void procmsg_set_flags(GSList *mlist, FolderItem *item)
 		if (lastnum < msginfo->msgnum)
 			lastnum = msginfo->msgnum;
 
-		flags = g_hash_table_lookup
-			(mark_table, GUINT_TO_POINTER(msginfo->msgnum));
+		i = mark_table_lookup(mark_table, msginfo->msgnum);
 
-		if (flags != NULL) {
+		if (i >= 0) {
 			/* add the permanent flags only */
-			msginfo->flags.perm_flags = flags->perm_flags;
-			if (MSG_IS_NEW(*flags))
+			msginfo->flags.perm_flags = mark_table->flags[i];
+			if ((mark_table->flags[i] & MSG_NEW) != 0)
 				++new;
-			if (MSG_IS_UNREAD(*flags))
+			if ((mark_table->flags[i] & MSG_UNREAD) != 0)
 				++unread;
 			if (FOLDER_TYPE(item->folder) == F_IMAP) {
 				MSG_SET_TMP_FLAGS(msginfo->flags, MSG_IMAP);
@@ -438,27 +438,20 @@ void procmsg_set_flags(GSList *mlist, FolderItem *item)
 	debug_print("new: %d unread: %d unflagged: %d total: %d\n",
 		    new, unread, unflagged, total);
 
-	hash_free_value_mem(mark_table);
-	g_hash_table_destroy(mark_table);
-}
-
-static void mark_all_read_func(gpointer key, gpointer value, gpointer data)
-{
-	MSG_UNSET_PERM_FLAGS(*((MsgFlags *)value), MSG_NEW|MSG_UNREAD);
+	mark_table_free(mark_table);
 }
 
 void procmsg_mark_all_read(FolderItem *item)
 {
-	GHashTable *mark_table;
+	MarkTable *mark_table;
 
 	debug_print("Marking all messages as read\n");
 
 	mark_table = procmsg_read_mark_file(item);
 	if (mark_table) {
-		g_hash_table_foreach(mark_table, mark_all_read_func, NULL);
+		mark_table_unset_flags(mark_table, MSG_NEW|MSG_UNREAD);
 		procmsg_write_mark_file(item, mark_table);
-		hash_free_value_mem(mark_table);
-		g_hash_table_destroy(mark_table);
+		mark_table_free(mark_table);
 	}
 
 	if (item->mark_queue) {
@@ -542,6 +535,71 @@ void procmsg_msg_list_free(GSList *mlist)
 	g_slist_free(mlist);
 }
 
+/* Compares mlist with new_mlist, the current message list of the same
+   folder, and moves the difference into three lists:
+   added:   the MsgInfo in new_mlist which are not in mlist
+   removed: the MsgInfo in mlist which are not in new_mlist
+   changed: the MsgInfo in mlist whose permanent flags were updated from
+	    new_mlist
+   A message is the same if the number, size and mtime match. new_mlist is
+   consumed; its MsgInfo other than the added ones are freed. */
+void procmsg_update_msg_list(GSList *mlist, GSList *new_mlist,
+			     GSList **added, GSList **removed,
+			     GSList **changed)
+{
+	GHashTable *table;
+	GSList *cur;
+	MsgInfo *msginfo, *old_msginfo;
+
+	g_return_if_fail(added != NULL);
+	g_return_if_fail(removed != NULL);
+	g_return_if_fail(changed != NULL);
+
+	*added = *removed = *changed = NULL;
+
+	table = g_hash_table_new(NULL, NULL);
+	for (cur = mlist; cur != NULL; cur = cur->next) {
+		msginfo = (MsgInfo *)cur->data;
+		g_hash_table_insert(table, GUINT_TO_POINTER(msginfo->msgnum),
+				    msginfo);
+	}
+
+	for (cur = new_mlist; cur != NULL; cur = cur->next) {
+		msginfo = (MsgInfo *)cur->data;
+		old_msginfo = g_hash_table_lookup
+			(table, GUINT_TO_POINTER(msginfo->msgnum));
+
+		if (old_msginfo && old_msginfo->size == msginfo->size &&
+		    old_msginfo->mtime == msginfo->mtime) {
+			g_hash_table_remove
+				(table, GUINT_TO_POINTER(msginfo->msgnum));
+			if (old_msginfo->flags.perm_flags !=
+			    msginfo->flags.perm_flags) {
+				old_msginfo->flags.perm_flags =
+					msginfo->flags.perm_flags;
+				*changed = g_slist_prepend(*changed,
+							   old_msginfo);
+			}
+			procmsg_msginfo_free(msginfo);
+		} else
+			*added = g_slist_prepend(*added, msginfo);
+	}
+	g_slist_free(new_mlist);
+
+	for (cur = mlist; cur != NULL; cur = cur->next) {
+		msginfo = (MsgInfo *)cur->data;
+		if (g_hash_table_lookup(table,
+					GUINT_TO_POINTER(msginfo->msgnum)) ==
+		    msginfo)
+			*removed = g_slist_prepend(*removed, msginfo);
+	}
+	g_hash_table_destroy(table);
+
+	*added = g_slist_reverse(*added);
+	*removed = g_slist_reverse(*removed);
+	*changed = g_slist_reverse(*changed);
+}
+
 void procmsg_write_cache(MsgInfo *msginfo, FILE *fp)
 {
 	MsgTmpFlags flags = msginfo->flags.tmp_flags & MSG_CACHED_FLAG_MASK;
@@ -600,6 +658,8 @@ void procmsg_write_cache_list(FolderItem *item, GSList *mlist)
 
 	fclose(fp);
 	item->cache_dirty = FALSE;
+
+	procmime_write_mime_cache(item, mlist);
 }
 
 void procmsg_write_flags_list(FolderItem *item, GSList *mlist)
@@ -673,6 +733,88 @@ void procmsg_write_flags_for_multiple_folders(GSList *mlist)
 	g_slist_free(tmp_list);
 }
 
+/* Set add_flags and unset remove_flags of the messages in one batch.
+   Only the messages whose permanent flags actually change are touched:
+   they get MSG_FLAG_CHANGED, the new/unread counters of their folders are
+   adjusted and the folders are marked dirty, so that each mark file is
+   written once when the summary is saved. Messages in IMAP folders are
+   stored on the server per folder with the merged sequence sets.
+   Returns the list of the changed messages. */
+GSList *procmsg_change_flags_for_msg_list(GSList *mlist,
+					  MsgPermFlags add_flags,
+					  MsgPermFlags remove_flags)
+{
+	GSList *changed = NULL;
+	GSList *tmp_list, *cur;
+	MsgInfo *msginfo;
+	FolderItem *item;
+	MsgPermFlags old_flags, new_flags;
+
+	for (cur = mlist; cur != NULL; cur = cur->next) {
+		msginfo = (MsgInfo *)cur->data;
+		item = msginfo->folder;
+
+		old_flags = msginfo->flags.perm_flags;
+		new_flags = (old_flags | add_flags) & ~remove_flags;
+		if (old_flags == new_flags)
+			continue;
+
+		if (item) {
+			if ((old_flags & MSG_NEW) && !(new_flags & MSG_NEW)) {
+				if (item->new > 0)
+					item->new--;
+			} else if (!(old_flags & MSG_NEW) &&
+				   (new_flags & MSG_NEW))
+				item->new++;
+			if ((old_flags & MSG_UNREAD) &&
+			    !(new_flags & MSG_UNREAD)) {
+				if (item->unread > 0)
+					item->unread--;
+			} else if (!(old_flags & MSG_UNREAD) &&
+				   (new_flags & MSG_UNREAD))
+				item->unread++;
+			item->mark_dirty = TRUE;
+			item->updated = TRUE;
+		}
+
+		msginfo->flags.perm_flags = new_flags;
+		MSG_SET_TMP_FLAGS(msginfo->flags, MSG_FLAG_CHANGED);
+		changed = g_slist_prepend(changed, msginfo);
+	}
+
+	changed = g_slist_reverse(changed);
+
+	/* store the flags of each IMAP folder at once */
+	tmp_list = g_slist_copy(changed);
+	tmp_list = g_slist_sort(tmp_list, cmp_by_item);
+
+	cur = tmp_list;
+	while (cur != NULL) {
+		GSList *folder_list = NULL;
+
+		item = ((MsgInfo *)cur->data)->folder;
+		for (; cur != NULL && ((MsgInfo *)cur->data)->folder == item;
+		     cur = cur->next)
+			folder_list = g_slist_prepend(folder_list, cur->data);
+
+		if (item && item->folder &&
+		    FOLDER_TYPE(item->folder) == F_IMAP) {
+			if (add_flags)
+				imap_msg_list_set_perm_flags(folder_list,
+							     add_flags);
+			if (remove_flags)
+				imap_msg_list_unset_perm_flags(folder_list,
+							       remove_flags);
+		}
+
+		g_slist_free(folder_list);
+	}
+
+	g_slist_free(tmp_list);
+
+	return changed;
+}
+
 void procmsg_flush_mark_queue(FolderItem *item, FILE *fp)
 {
 	MsgFlagInfo *flaginfo;
@@ -858,109 +1000,171 @@ void procmsg_add_flags(FolderItem *item, gint num, MsgFlags flags)
 	fclose(fp);
 }
 
-struct MarkSum {
-	gint *new;
-	gint *unread;
-	gint *total;
-	gint *min;
-	gint *max;
-	gint first;
-};
+void procmsg_get_mark_sum(FolderItem *item,
+			  gint *new, gint *unread, gint *total,
+			  gint *min, gint *max,
+			  gint first)
+{
+	MarkTable *mark_table;
+	guint i;
+
+	*new = *unread = *total = *min = *max = 0;
+
+	mark_table = procmsg_read_mark_file(item);
+	if (!mark_table)
+		return;
+
+	i = mark_table_lower_bound(mark_table, first > 0 ? first : 0);
+	if (i < mark_table->len) {
+		*min = mark_table->nums[i];
+		*max = mark_table->nums[mark_table->len - 1];
+		*total = mark_table->len - i;
+	}
+	for (; i < mark_table->len; i++) {
+		if ((mark_table->flags[i] & MSG_NEW) != 0) (*new)++;
+		if ((mark_table->flags[i] & MSG_UNREAD) != 0) (*unread)++;
+	}
+
+	mark_table_free(mark_table);
+}
+
+static gint mark_record_cmp(gconstpointer a, gconstpointer b, gpointer data)
+{
+	const MarkRecord *ra = a;
+	const MarkRecord *rb = b;
 
-static void mark_sum_func(gpointer key, gpointer value, gpointer data)
+	if (ra->num != rb->num)
+		return ra->num < rb->num ? -1 : 1;
+	if (ra->order != rb->order)
+		return ra->order < rb->order ? -1 : 1;
+	return 0;
+}
+
+/* Sort the records by number and keep only the last record of each
+   number, as a later record in the mark file overrides the earlier ones. */
+static MarkTable *mark_table_new(GArray *records)
 {
-	MsgFlags *flags = value;
-	gint num = GPOINTER_TO_INT(key);
-	struct MarkSum *marksum = data;
+	MarkTable *table;
+	MarkRecord *rec;
+	guint i;
+
+	g_qsort_with_data(records->data, records->len, sizeof(MarkRecord),
+			  mark_record_cmp, NULL);
+
+	table = g_new(MarkTable, 1);
+	table->len = 0;
+	table->nums = g_new(guint32, records->len);
+	table->flags = g_new(MsgPermFlags, records->len);
 
-	if (marksum->first <= num) {
-		if (MSG_IS_NEW(*flags)) (*marksum->new)++;
-		if (MSG_IS_UNREAD(*flags)) (*marksum->unread)++;
-		if (num > *marksum->max) *marksum->max = num;
-		if (num < *marksum->min || *marksum->min == 0) *marksum->min = num;
-		(*marksum->total)++;
+	rec = (MarkRecord *)records->data;
+	for (i = 0; i < records->len; i++) {
+		if (i + 1 < records->len && rec[i + 1].num == rec[i].num)
+			continue;
+		table->nums[table->len] = rec[i].num;
+		table->flags[table->len] = rec[i].flags;
+		table->len++;
 	}
 
-	g_free(flags);
+	return table;
 }
 
-void procmsg_get_mark_sum(FolderItem *item,
-			  gint *new, gint *unread, gint *total,
-			  gint *min, gint *max,
-			  gint first)
+static void mark_table_free(MarkTable *table)
 {
-	GHashTable *mark_table;
-	struct MarkSum marksum;
+	if (!table)
+		return;
 
-	*new = *unread = *total = *min = *max = 0;
-	marksum.new    = new;
-	marksum.unread = unread;
-	marksum.total  = total;
-	marksum.min    = min;
-	marksum.max    = max;
-	marksum.first  = first;
+	g_free(table->nums);
+	g_free(table->flags);
+	g_free(table);
+}
 
-	mark_table = procmsg_read_mark_file(item);
+/* return the index of the first number not less than num */
+static guint mark_table_lower_bound(MarkTable *table, guint num)
+{
+	guint lo = 0, hi = table->len, mid;
 
-	if (mark_table) {
-		g_hash_table_foreach(mark_table, mark_sum_func, &marksum);
-		g_hash_table_destroy(mark_table);
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (table->nums[mid] < num)
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
+
+	return lo;
+}
+
+static gint mark_table_lookup(MarkTable *table, guint num)
+{
+	guint i;
+
+	i = mark_table_lower_bound(table, num);
+	if (i < table->len && table->nums[i] == num)
+		return i;
+
+	return -1;
 }
 
-static GHashTable *procmsg_read_mark_file(FolderItem *item)
+static void mark_table_unset_flags(MarkTable *table, MsgPermFlags flags)
+{
+	MsgPermFlags *p = table->flags;
+	MsgPermFlags *end = table->flags + table->len;
+
+	for (; p < end; p++)
+		*p &= ~flags;
+}
+
+#define MARK_READ_BUFSIZE	1024
+
+static MarkTable *procmsg_read_mark_file(FolderItem *item)
 {
 	FILE *fp;
-	GHashTable *mark_table = NULL;
-	guint32 idata;
-	guint num;
-	MsgFlags *flags;
-	MsgPermFlags perm_flags;
+	MarkTable *mark_table;
+	GArray *records;
+	MarkRecord rec;
+	guint32 idata[MARK_READ_BUFSIZE * 2];
+	size_t n, i;
+	guint order = 0;
 	GSList *cur;
 
 	if ((fp = procmsg_open_mark_file(item, DATA_READ)) == NULL)
 		return NULL;
 
-	mark_table = g_hash_table_new(NULL, g_direct_equal);
-
-	while (fread(&idata, sizeof(idata), 1, fp) == 1) {
-		num = idata;
-		if (fread(&idata, sizeof(idata), 1, fp) != 1) break;
-		perm_flags = idata;
+	records = g_array_new(FALSE, FALSE, sizeof(MarkRecord));
 
-		flags = g_hash_table_lookup(mark_table, GUINT_TO_POINTER(num));
-		if (flags != NULL)
-			g_free(flags);
-
-		flags = g_new0(MsgFlags, 1);
-		flags->perm_flags = perm_flags;
-
-		g_hash_table_insert(mark_table, GUINT_TO_POINTER(num), flags);
+	/* each record is a pair of the number and the permanent flags */
+	while ((n = fread(idata, sizeof(guint32) * 2, MARK_READ_BUFSIZE,
+			  fp)) > 0) {
+		for (i = 0; i < n; i++) {
+			rec.num = idata[i * 2];
+			rec.flags = idata[i * 2 + 1];
+			rec.order = order++;
+			g_array_append_val(records, rec);
+		}
+		if (n < MARK_READ_BUFSIZE)
+			break;
 	}
 
 	fclose(fp);
 
 	if (item->mark_queue) {
-		g_hash_table_foreach(mark_table, mark_unset_new_func, NULL);
+		for (i = 0; i < records->len; i++)
+			g_array_index(records, MarkRecord, i).flags &= ~MSG_NEW;
 		item->mark_dirty = TRUE;
 	}
 
 	for (cur = item->mark_queue; cur != NULL; cur = cur->next) {
 		MsgFlagInfo *flaginfo = (MsgFlagInfo *)cur->data;
 
-		flags = g_hash_table_lookup(mark_table,
-					    GUINT_TO_POINTER(flaginfo->msgnum));
-		if (flags != NULL)
-			g_free(flags);
-
-		flags = g_new0(MsgFlags, 1);
-		flags->perm_flags = flaginfo->flags.perm_flags;
-
-		g_hash_table_insert(mark_table,
-				    GUINT_TO_POINTER(flaginfo->msgnum), flags);
-				    
+		rec.num = flaginfo->msgnum;
+		rec.flags = flaginfo->flags.perm_flags;
+		rec.order = order++;
+		g_array_append_val(records, rec);
 	}
 
+	mark_table = mark_table_new(records);
+	g_array_free(records, TRUE);
+
 	if (item->mark_queue && !item->opened) {
 		procmsg_write_mark_file(item, mark_table);
 		procmsg_flaginfo_list_free(item->mark_queue);
@@ -971,24 +1175,19 @@ static GHashTable *procmsg_read_mark_file(FolderItem *item)
 	return mark_table;
 }
 
-static void write_mark_func(gpointer key, gpointer value, gpointer data)
-{
-	MsgInfo msginfo;
-
-	msginfo.msgnum = GPOINTER_TO_UINT(key);
-	msginfo.flags.perm_flags = ((MsgFlags *)value)->perm_flags;
-	procmsg_write_flags(&msginfo, (FILE *)data);
-}
-
-static void procmsg_write_mark_file(FolderItem *item, GHashTable *mark_table)
+static void procmsg_write_mark_file(FolderItem *item, MarkTable *mark_table)
 {
 	FILE *fp;
+	guint i;
 
 	if ((fp = procmsg_open_mark_file(item, DATA_WRITE)) == NULL) {
 		g_warning("procmsg_write_mark_file: cannot open mark file.");
 		return;
 	}
-	g_hash_table_foreach(mark_table, write_mark_func, fp);
+	for (i = 0; i < mark_table->len; i++) {
+		WRITE_CACHE_DATA_INT(mark_table->nums[i], fp);
+		WRITE_CACHE_DATA_INT(mark_table->flags[i], fp);
+	}
 	fclose(fp);
 }
 
@@ -1130,67 +1329,106 @@ void procmsg_clear_mark(FolderItem *item)
 		fclose(fp);
 }
 
-/* return the reversed thread tree */
+/* return the reversed thread tree (the thread roots are in reverse order).
+   Threads the messages in linear time. Each message gets the message of its
+   In-Reply-To as the parent, or failing that the nearest message found in
+   its References. Parent links which form a loop are cut at the earliest
+   message of the loop, which becomes the thread root. */
 GNode *procmsg_get_thread_tree(GSList *mlist)
 {
-	GNode *root, *parent, *node, *next;
+	GNode *root;
+	GNode **nodes, **last;
 	GHashTable *table;
 	MsgInfo *msginfo;
-	const gchar *msgid;
-	GSList *reflist;
+	GSList *cur, *reflist;
+	gint *parent, *stack;
+	guchar *state;
+	gint n, i, j, k, sp;
 
 	root = g_node_new(NULL);
-	table = g_hash_table_new(g_str_hash, g_str_equal);
 
-	for (; mlist != NULL; mlist = mlist->next) {
-		msginfo = (MsgInfo *)mlist->data;
-		parent = root;
+	n = g_slist_length(mlist);
+	if (n == 0)
+		return root;
 
-		/* only look for the real parent first */
-		if (msginfo->inreplyto) {
-			parent = g_hash_table_lookup(table, msginfo->inreplyto);
-			if (parent == NULL)
-				parent = root;
-		}
+	nodes = g_new(GNode *, n);
+	last = g_new0(GNode *, n);
+	parent = g_new(gint, n);
+	stack = g_new(gint, n);
+	state = g_new0(guchar, n);
+	table = g_hash_table_new(g_str_hash, g_str_equal);
 
-		node = g_node_insert_data_before
-			(parent, parent == root ? parent->children : NULL,
-			 msginfo);
-		if ((msgid = msginfo->msgid) &&
-		    g_hash_table_lookup(table, msgid) == NULL)
-			g_hash_table_insert(table, (gchar *)msgid, node);
+	/* message-id -> index of the first message which has it */
+	for (cur = mlist, i = 0; cur != NULL; cur = cur->next, i++) {
+		msginfo = (MsgInfo *)cur->data;
+		nodes[i] = g_node_new(msginfo);
+		if (msginfo->msgid &&
+		    g_hash_table_lookup(table, msginfo->msgid) == NULL)
+			g_hash_table_insert(table, msginfo->msgid,
+					    GINT_TO_POINTER(i + 1));
 	}
 
-	/* complete the unfinished threads */
-	for (node = root->children; node != NULL; ) {
-		next = node->next;
-		msginfo = (MsgInfo *)node->data;
-		parent = NULL;
+	for (cur = mlist, i = 0; cur != NULL; cur = cur->next, i++) {
+		msginfo = (MsgInfo *)cur->data;
+		j = 0;
 
+		/* look for the real parent first */
 		if (msginfo->inreplyto)
-			parent = g_hash_table_lookup(table, msginfo->inreplyto);
-
-		/* try looking for the indirect parent */
-		if (!parent && msginfo->references) {
-			for (reflist = msginfo->references;
-			     reflist != NULL; reflist = reflist->next)
-				if ((parent = g_hash_table_lookup
-					(table, reflist->data)) != NULL)
-					break;
+			j = GPOINTER_TO_INT(g_hash_table_lookup
+				(table, msginfo->inreplyto));
+		/* then for the indirect parent */
+		for (reflist = msginfo->references; j == 0 && reflist != NULL;
+		     reflist = reflist->next)
+			j = GPOINTER_TO_INT(g_hash_table_lookup
+				(table, reflist->data));
+
+		parent[i] = (j - 1 == i) ? -1 : j - 1;
+	}
+
+	g_hash_table_destroy(table);
+
+	/* break circular references. state: 0 = unvisited,
+	   1 = on the current path, 2 = done */
+	for (i = 0; i < n; i++) {
+		sp = 0;
+		for (j = i; j >= 0 && state[j] == 0; j = parent[j]) {
+			state[j] = 1;
+			stack[sp++] = j;
 		}
+		if (j >= 0 && state[j] == 1) {
+			gint first = j;
 
-		/* node should not be the parent, and node should not
-		   be an ancestor of parent (circular reference) */
-		if (parent && parent != node &&
-		    !g_node_is_ancestor(node, parent)) {
-			g_node_unlink(node);
-			g_node_insert_before
-				(parent, parent->children, node);
+			for (k = sp - 1; stack[k] != j; k--) {
+				if (stack[k] < first)
+					first = stack[k];
+			}
+			parent[first] = -1;
 		}
-		node = next;
+		for (k = 0; k < sp; k++)
+			state[stack[k]] = 2;
 	}
 
-	g_hash_table_destroy(table);
+	/* keep the message order in the children, and the reverse order
+	   in the thread roots */
+	for (i = 0; i < n; i++) {
+		j = parent[i];
+		if (j < 0)
+			g_node_prepend(root, nodes[i]);
+		else {
+			if (last[j])
+				g_node_insert_after(nodes[j], last[j],
+						    nodes[i]);
+			else
+				g_node_prepend(nodes[j], nodes[i]);
+			last[j] = nodes[i];
+		}
+	}
+
+	g_free(state);
+	g_free(stack);
+	g_free(parent);
+	g_free(last);
+	g_free(nodes);
 
 	return root;
 }
@@ -1443,15 +1681,11 @@ FILE *procmsg_open_message_decrypted(MsgInfo *msginfo, MimeInfo **mimeinfo)
 
 gboolean procmsg_msg_exist(MsgInfo *msginfo)
 {
-	gchar *path;
 	gboolean ret;
 
 	if (!msginfo) return FALSE;
 
-	path = folder_item_get_path(msginfo->folder);
-	change_dir(path);
 	ret = !folder_item_is_msg_changed(msginfo->folder, msginfo);
-	g_free(path);
 
 	return ret;
 }
@@ -235,6 +235,11 @@ GSList *procmsg_sort_msg_list		(GSList		*mlist,
 					 FolderSortType	 sort_type);
 gint	procmsg_get_last_num_in_msg_list(GSList		*mlist);
 void	procmsg_msg_list_free		(GSList		*mlist);
+void	procmsg_update_msg_list		(GSList		*mlist,
+					 GSList		*new_mlist,
+					 GSList	       **added,
+					 GSList	       **removed,
+					 GSList	       **changed);
 
 void	procmsg_write_cache		(MsgInfo	*msginfo,
 					 FILE		*fp);
@@ -247,6 +252,11 @@ void	procmsg_write_flags_list	(FolderItem	*item,
 void	procmsg_write_flags_for_multiple_folders
 					(GSList		*mlist);
 
+GSList *procmsg_change_flags_for_msg_list
+					(GSList		*mlist,
+					 MsgPermFlags	 add_flags,
+					 MsgPermFlags	 remove_flags);
+
 void	procmsg_flaginfo_list_free	(GSList		*flaglist);
 
 void	procmsg_flush_mark_queue	(FolderItem	*item,
@@ -117,6 +117,7 @@ void session_init(Session *session)
 	session->write_buf_len = 0;
 
 	session->write_data_fp = NULL;
+	session->write_data_start = 0;
 	session->write_data_pos = 0;
 	session->write_data_len = 0;
 
@@ -548,17 +549,33 @@ static gboolean session_recv_msg_idle_cb(gpointer data)
 }
 
 gint session_send_data(Session *session, FILE *data_fp, guint size)
+{
+	return session_send_data_full(session, NULL, data_fp, size);
+}
+
+/* send a command line (if msg is not NULL) immediately followed by data
+   without waiting for the server response in between */
+gint session_send_data_full(Session *session, const gchar *msg, FILE *data_fp,
+			    guint size)
 {
 	gboolean ret;
 
 	g_return_val_if_fail(session->sock != NULL, -1);
 	g_return_val_if_fail(session->write_data_fp == NULL, -1);
+	g_return_val_if_fail(session->write_buf == NULL, -1);
 	g_return_val_if_fail(data_fp != NULL, -1);
 	g_return_val_if_fail(size != 0, -1);
 
 	session->state = SESSION_SEND;
 
+	if (msg) {
+		session->write_buf = g_strconcat(msg, "\r\n", NULL);
+		session->write_buf_p = session->write_buf;
+		session->write_buf_len = strlen(msg) + 2;
+	}
+
 	session->write_data_fp = data_fp;
+	session->write_data_start = ftell(data_fp);
 	session->write_data_pos = 0;
 	session->write_data_len = size;
 	g_get_current_time(&session->tv_prev);
@@ -1095,11 +1112,8 @@ static gint session_write_buf(Session *session)
 	return 0;
 }
 
-#define WRITE_DATA_BUFFSIZE	8192
-
 static gint session_write_data(Session *session, gint *nwritten)
 {
-	gchar buf[WRITE_DATA_BUFFSIZE];
 	gint write_len;
 	gint to_write_len;
 
@@ -1108,14 +1122,12 @@ static gint session_write_data(Session *session, gint *nwritten)
 	g_return_val_if_fail(session->write_data_len > 0, -1);
 
 	to_write_len = session->write_data_len - session->write_data_pos;
-	to_write_len = MIN(to_write_len, WRITE_DATA_BUFFSIZE);
-	if (fread(buf, to_write_len, 1, session->write_data_fp) < 1) {
-		g_warning("session_write_data: reading data from file failed\n");
-		session->state = SESSION_ERROR;
-		return -1;
-	}
 
-	write_len = sock_write(session->sock, buf, to_write_len);
+	/* the data is sent directly from the file by sendfile() if
+	   the socket is not SSL */
+	write_len = sock_write_file(session->sock, session->write_data_fp,
+				    session->write_data_start +
+				    session->write_data_pos, to_write_len);
 
 	if (write_len < 0) {
 		switch (errno) {
@@ -1123,7 +1135,7 @@ static gint session_write_data(Session *session, gint *nwritten)
 			write_len = 0;
 			break;
 		default:
-			g_warning("sock_write: %s\n", g_strerror(errno));
+			g_warning("sock_write_file: %s\n", g_strerror(errno));
 			session->state = SESSION_ERROR;
 			*nwritten = write_len;
 			return -1;
@@ -1135,18 +1147,11 @@ static gint session_write_data(Session *session, gint *nwritten)
 	/* incomplete write */
 	if (session->write_data_pos + write_len < session->write_data_len) {
 		session->write_data_pos += write_len;
-		if (write_len < to_write_len) {
-			if (fseek(session->write_data_fp,
-				  session->write_data_pos, SEEK_SET) < 0) {
-				g_warning("session_write_data: file seek failed\n");
-				session->state = SESSION_ERROR;
-				return -1;
-			}
-		}
 		return 1;
 	}
 
 	session->write_data_fp = NULL;
+	session->write_data_start = 0;
 	session->write_data_pos = 0;
 	session->write_data_len = 0;
 
@@ -1195,6 +1200,16 @@ static gboolean session_write_data_cb(SockInfo *source,
 	g_return_val_if_fail(session->write_data_pos >= 0, FALSE);
 	g_return_val_if_fail(session->write_data_len > 0, FALSE);
 
+	/* flush the preceding command line first */
+	if (session->write_buf) {
+		ret = session_write_buf(session);
+		if (ret < 0) {
+			session->state = SESSION_ERROR;
+			return FALSE;
+		} else if (ret > 0)
+			return TRUE;
+	}
+
 	write_data_len = session->write_data_len;
 
 	ret = session_write_data(session, &write_len);
@@ -137,6 +137,7 @@ struct _Session
 
 	/* buffer for large data */
 	FILE *write_data_fp;
+	gint write_data_start;
 	gint write_data_pos;
 	gint write_data_len;
 
@@ -224,6 +225,10 @@ gint session_recv_msg	(Session	*session);
 gint session_send_data	(Session	*session,
 			 FILE		*data_fp,
 			 guint		 size);
+gint session_send_data_full	(Session	*session,
+				 const gchar	*msg,
+				 FILE		*data_fp,
+				 guint		 size);
 gint session_recv_data	(Session	*session,
 			 guint		 size,
 			 const gchar	*terminator);
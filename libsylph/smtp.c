@@ -48,7 +48,8 @@ static gint smtp_helo(SMTPSession *session);
 static gint smtp_rcpt(SMTPSession *session);
 static gint smtp_data(SMTPSession *session);
 static gint smtp_send_data(SMTPSession *session);
-/* static gint smtp_rset(SMTPSession *session); */
+static gint smtp_bdat(SMTPSession *session);
+static gint smtp_rset(SMTPSession *session);
 static gint smtp_quit(SMTPSession *session);
 static gint smtp_eom(SMTPSession *session);
 
@@ -89,6 +90,13 @@ Session *smtp_session_new(void)
 
 	session->send_data_fp              = NULL;
 	session->send_data_len             = 0;
+	session->send_data_dot_stuffed     = TRUE;
+
+	session->avail_esmtp_flags         = 0;
+	session->pipelining                = FALSE;
+
+	session->next_msg_func             = NULL;
+	session->next_msg_data             = NULL;
 
 	session->avail_auth_type           = 0;
 	session->forced_auth_type          = 0;
@@ -115,22 +123,95 @@ static void smtp_session_destroy(Session *session)
 	g_free(smtp_session->error_msg);
 }
 
+#define SMTP_USE_BDAT(session)						\
+	(((session)->avail_esmtp_flags & ESMTP_CHUNKING) != 0 &&	\
+	 !(session)->send_data_dot_stuffed)
+
+/* fallback for data which was not dot-stuffed although DATA has to be
+   used */
+static gint smtp_dot_stuff_data(SMTPSession *session)
+{
+	FILE *fp;
+	gint len;
+
+	if (session->send_data_dot_stuffed || !session->send_data_fp)
+		return SM_OK;
+
+	fp = dot_stuff_file_stream(session->send_data_fp, &len);
+	if (!fp)
+		return SM_ERROR;
+
+	fclose(session->send_data_fp);
+	session->send_data_fp = fp;
+	session->send_data_len = len;
+	session->send_data_dot_stuffed = TRUE;
+
+	return SM_OK;
+}
+
+static void smtp_append_rcpt(SMTPSession *session, GString *str,
+			     const gchar *to)
+{
+	gchar buf[SMTPBUFSIZE];
+
+	if (strchr(to, '<'))
+		g_snprintf(buf, sizeof(buf), "RCPT TO:%s", to);
+	else
+		g_snprintf(buf, sizeof(buf), "RCPT TO:<%s>", to);
+	log_print("SMTP> %s\n", buf);
+
+	if (str->len > 0)
+		g_string_append(str, "\r\n");
+	g_string_append(str, buf);
+}
+
 static gint smtp_from(SMTPSession *session)
 {
 	gchar buf[SMTPBUFSIZE];
+	GString *cmds;
+	GSList *cur;
 
 	g_return_val_if_fail(session->from != NULL, SM_ERROR);
 
 	session->state = SMTP_FROM;
 
+	if (!SMTP_USE_BDAT(session) && smtp_dot_stuff_data(session) != SM_OK) {
+		log_warning(_("can't prepare the message data\n"));
+		session->state = SMTP_ERROR;
+		session->error_val = SM_UNRECOVERABLE;
+		session_disconnect(SESSION(session));
+		return SM_UNRECOVERABLE;
+	}
+
 	if (strchr(session->from, '<'))
 		g_snprintf(buf, sizeof(buf), "MAIL FROM:%s", session->from);
 	else
 		g_snprintf(buf, sizeof(buf), "MAIL FROM:<%s>", session->from);
 
-	session_send_msg(SESSION(session), SESSION_MSG_NORMAL, buf);
 	log_print("SMTP> %s\n", buf);
 
+	if ((session->avail_esmtp_flags & ESMTP_PIPELINING) == 0 ||
+	    !session->cur_to) {
+		session->pipelining = FALSE;
+		session_send_msg(SESSION(session), SESSION_MSG_NORMAL, buf);
+		return SM_OK;
+	}
+
+	/* RFC 2920: send MAIL FROM, all RCPT TO and DATA in one go and
+	   read the responses afterwards in order */
+	session->pipelining = TRUE;
+
+	cmds = g_string_new(buf);
+	for (cur = session->cur_to; cur != NULL; cur = cur->next)
+		smtp_append_rcpt(session, cmds, (gchar *)cur->data);
+	if (!SMTP_USE_BDAT(session)) {
+		g_string_append(cmds, "\r\nDATA");
+		log_print("SMTP> DATA\n");
+	}
+
+	session_send_msg(SESSION(session), SESSION_MSG_NORMAL, cmds->str);
+	g_string_free(cmds, TRUE);
+
 	return SM_OK;
 }
 
@@ -260,6 +341,7 @@ static gint smtp_ehlo(SMTPSession *session)
 	session->state = SMTP_EHLO;
 
 	session->avail_auth_type = 0;
+	session->avail_esmtp_flags = 0;
 
 	g_snprintf(buf, sizeof(buf), "EHLO %s",
 		   session->hostname ? session->hostname : get_domain_name());
@@ -285,7 +367,21 @@ static gint smtp_ehlo_recv(SMTPSession *session, const gchar *msg)
 				session->avail_auth_type |= SMTPAUTH_CRAM_MD5;
 			if (strcasestr(p, "DIGEST-MD5"))
 				session->avail_auth_type |= SMTPAUTH_DIGEST_MD5;
-		}
+		} else if (!g_ascii_strncasecmp(p, "PIPELINING", 10) &&
+			   (p[10] == '\0' || p[10] == ' '))
+			session->avail_esmtp_flags |= ESMTP_PIPELINING;
+		else if (!g_ascii_strncasecmp(p, "CHUNKING", 8) &&
+			 (p[8] == '\0' || p[8] == ' '))
+			session->avail_esmtp_flags |= ESMTP_CHUNKING;
+		else if (!g_ascii_strncasecmp(p, "8BITMIME", 8) &&
+			 (p[8] == '\0' || p[8] == ' '))
+			session->avail_esmtp_flags |= ESMTP_8BITMIME;
+		else if (!g_ascii_strncasecmp(p, "SIZE", 4) &&
+			 (p[4] == '\0' || p[4] == ' '))
+			session->avail_esmtp_flags |= ESMTP_SIZE;
+		else if (!g_ascii_strncasecmp(p, "ETRN", 4) &&
+			 (p[4] == '\0' || p[4] == ' '))
+			session->avail_esmtp_flags |= ESMTP_ETRN;
 		return SM_OK;
 	} else if ((msg[0] == '1' || msg[0] == '2' || msg[0] == '3') &&
 	    (msg[3] == ' ' || msg[3] == '\0'))
@@ -384,21 +480,16 @@ static gint smtp_helo(SMTPSession *session)
 
 static gint smtp_rcpt(SMTPSession *session)
 {
-	gchar buf[SMTPBUFSIZE];
-	gchar *to;
+	GString *buf;
 
 	g_return_val_if_fail(session->cur_to != NULL, SM_ERROR);
 
 	session->state = SMTP_RCPT;
 
-	to = (gchar *)session->cur_to->data;
-
-	if (strchr(to, '<'))
-		g_snprintf(buf, sizeof(buf), "RCPT TO:%s", to);
-	else
-		g_snprintf(buf, sizeof(buf), "RCPT TO:<%s>", to);
-	session_send_msg(SESSION(session), SESSION_MSG_NORMAL, buf);
-	log_print("SMTP> %s\n", buf);
+	buf = g_string_new(NULL);
+	smtp_append_rcpt(session, buf, (gchar *)session->cur_to->data);
+	session_send_msg(SESSION(session), SESSION_MSG_NORMAL, buf->str);
+	g_string_free(buf, TRUE);
 
 	session->cur_to = session->cur_to->next;
 
@@ -425,7 +516,23 @@ static gint smtp_send_data(SMTPSession *session)
 	return SM_OK;
 }
 
-#if 0
+/* RFC 3030: BDAT does not need the transparency procedure and the
+   terminating dot */
+static gint smtp_bdat(SMTPSession *session)
+{
+	gchar buf[SMTPBUFSIZE];
+
+	session->state = SMTP_BDAT;
+
+	g_snprintf(buf, sizeof(buf), "BDAT %d LAST", session->send_data_len);
+	log_print("ESMTP> %s\n", buf);
+
+	session_send_data_full(SESSION(session), buf, session->send_data_fp,
+			       session->send_data_len);
+
+	return SM_OK;
+}
+
 static gint smtp_rset(SMTPSession *session)
 {
 	session->state = SMTP_RSET;
@@ -435,7 +542,6 @@ static gint smtp_rset(SMTPSession *session)
 
 	return SM_OK;
 }
-#endif
 
 static gint smtp_quit(SMTPSession *session)
 {
@@ -482,6 +588,18 @@ static gint smtp_session_recv_msg(Session *session, const gchar *msg)
 		break;
 	}
 
+#if USE_SSL
+	if (smtp_session->state == SMTP_EHLO && msg[0] == '5' &&
+	    !smtp_session->user && session->ssl_type == SSL_NONE) {
+#else
+	if (smtp_session->state == SMTP_EHLO && msg[0] == '5' &&
+	    !smtp_session->user) {
+#endif
+		/* ESMTP is not supported: fall back to HELO */
+		smtp_helo(smtp_session);
+		return 0;
+	}
+
 	if (msg[0] == '5' && msg[1] == '0' &&
 	    (msg[2] == '4' || msg[2] == '3' || msg[2] == '1')) {
 		log_warning(_("error occurred on SMTP session\n"));
@@ -526,14 +644,7 @@ static gint smtp_session_recv_msg(Session *session, const gchar *msg)
 	switch (smtp_session->state) {
 	case SMTP_READY:
 	case SMTP_CONNECTED:
-#if USE_SSL
-		if (smtp_session->user || session->ssl_type != SSL_NONE)
-#else
-		if (smtp_session->user)
-#endif
-			smtp_ehlo(smtp_session);
-		else
-			smtp_helo(smtp_session);
+		smtp_ehlo(smtp_session);
 		break;
 	case SMTP_HELO:
 		smtp_from(smtp_session);
@@ -579,12 +690,29 @@ static gint smtp_session_recv_msg(Session *session, const gchar *msg)
 		smtp_from(smtp_session);
 		break;
 	case SMTP_FROM:
+		if (smtp_session->pipelining) {
+			smtp_session->state = SMTP_RCPT;
+			return session_recv_msg(session);
+		}
 		if (smtp_session->cur_to)
 			smtp_rcpt(smtp_session);
 		break;
 	case SMTP_RCPT:
-		if (smtp_session->cur_to)
+		if (smtp_session->pipelining) {
+			/* cur_to points to the recipient of this response */
+			smtp_session->cur_to = smtp_session->cur_to->next;
+			if (smtp_session->cur_to)
+				return session_recv_msg(session);
+			if (SMTP_USE_BDAT(smtp_session))
+				smtp_bdat(smtp_session);
+			else {
+				smtp_session->state = SMTP_DATA;
+				return session_recv_msg(session);
+			}
+		} else if (smtp_session->cur_to)
 			smtp_rcpt(smtp_session);
+		else if (SMTP_USE_BDAT(smtp_session))
+			smtp_bdat(smtp_session);
 		else
 			smtp_data(smtp_session);
 		break;
@@ -592,7 +720,15 @@ static gint smtp_session_recv_msg(Session *session, const gchar *msg)
 		smtp_send_data(smtp_session);
 		break;
 	case SMTP_EOM:
-		smtp_quit(smtp_session);
+		if (smtp_session->next_msg_func &&
+		    smtp_session->next_msg_func
+			(smtp_session, smtp_session->next_msg_data))
+			smtp_rset(smtp_session);
+		else
+			smtp_quit(smtp_session);
+		break;
+	case SMTP_RSET:
+		smtp_from(smtp_session);
 		break;
 	case SMTP_QUIT:
 		session_disconnect(session);
@@ -612,6 +748,14 @@ static gint smtp_session_recv_msg(Session *session, const gchar *msg)
 
 static gint smtp_session_send_data_finished(Session *session, guint len)
 {
-	smtp_eom(SMTP_SESSION(session));
+	SMTPSession *smtp_session = SMTP_SESSION(session);
+
+	if (smtp_session->state == SMTP_BDAT) {
+		smtp_session->state = SMTP_EOM;
+		log_print("ESMTP> [%d bytes] (EOM)\n", len);
+		session_recv_msg(session);
+	} else
+		smtp_eom(smtp_session);
+
 	return 0;
 }
@@ -33,6 +33,9 @@ typedef struct _SMTPSession	SMTPSession;
 
 #define SMTP_SESSION(obj)	((SMTPSession *)obj)
 
+typedef gboolean (*SMTPNextMsgFunc)	(SMTPSession	*session,
+					 gpointer	 data);
+
 #define SMTPBUFSIZE		8192
 
 typedef enum
@@ -47,7 +50,9 @@ typedef enum
 {
 	ESMTP_8BITMIME	= 1 << 0,
 	ESMTP_SIZE	= 1 << 1,
-	ESMTP_ETRN	= 1 << 2
+	ESMTP_ETRN	= 1 << 2,
+	ESMTP_PIPELINING = 1 << 3,
+	ESMTP_CHUNKING	= 1 << 4
 } ESMTPFlag;
 
 typedef enum
@@ -74,6 +79,7 @@ typedef enum
 	SMTP_RCPT,
 	SMTP_DATA,
 	SMTP_SEND_DATA,
+	SMTP_BDAT,
 	SMTP_EOM,
 	SMTP_RSET,
 	SMTP_QUIT,
@@ -102,6 +108,16 @@ struct _SMTPSession
 
 	FILE *send_data_fp;
 	gint send_data_len;
+	/* FALSE if send_data_fp is not dot-stuffed (to be sent with BDAT) */
+	gboolean send_data_dot_stuffed;
+
+	ESMTPFlag avail_esmtp_flags;
+	gboolean pipelining;
+
+	/* called after a message was accepted. If it returns TRUE, the
+	   next message has been set and is sent on the same connection */
+	SMTPNextMsgFunc next_msg_func;
+	gpointer next_msg_data;
 
 	SMTPAuthType avail_auth_type;
 	SMTPAuthType forced_auth_type;
@@ -50,6 +50,10 @@
 #if HAVE_SYS_SELECT_H
 #  include <sys/select.h>
 #endif
+#if HAVE_SENDFILE && HAVE_SYS_SENDFILE_H
+#  include <sys/sendfile.h>
+#  define USE_SENDFILE	1
+#endif
 
 #include "socket.h"
 #if USE_SSL
@@ -1614,6 +1618,68 @@ gint fd_write_all(gint fd, const gchar *buf, gint len)
 	return wrlen;
 }
 
+#define WRITE_FILE_BUFFSIZE	8192
+
+/* write at most len bytes of fp starting at offset to the socket.
+   The data is passed to the kernel directly by sendfile() on plain
+   (non-SSL) sockets when available. */
+gint sock_write_file(SockInfo *sock, FILE *fp, gint offset, gint len)
+{
+	gchar buf[WRITE_FILE_BUFFSIZE];
+	gint read_len;
+
+	g_return_val_if_fail(sock != NULL, -1);
+	g_return_val_if_fail(fp != NULL, -1);
+	g_return_val_if_fail(offset >= 0, -1);
+	g_return_val_if_fail(len > 0, -1);
+
+#if USE_SENDFILE
+	if (!sock->ssl) {
+		off_t off = offset;
+		ssize_t ret;
+
+		if (fd_check_io(sock->sock, G_IO_OUT) < 0)
+			return -1;
+		ret = sendfile(sock->sock, fileno(fp), &off, len);
+		if (ret >= 0)
+			return ret;
+		if (errno != EINVAL && errno != ENOSYS)
+			return -1;
+		/* the file does not support sendfile(); use read/write */
+	}
+#endif
+
+	if (ftell(fp) != offset && fseek(fp, offset, SEEK_SET) < 0) {
+		g_warning("sock_write_file: file seek failed\n");
+		return -1;
+	}
+
+	len = MIN(len, (gint)sizeof(buf));
+	read_len = fread(buf, 1, len, fp);
+	if (read_len < len) {
+		g_warning("sock_write_file: reading data from file failed\n");
+		return -1;
+	}
+
+	return sock_write(sock, buf, read_len);
+}
+
+gint sock_write_file_all(SockInfo *sock, FILE *fp, gint offset, gint len)
+{
+	gint n, wrlen = 0;
+
+	while (len) {
+		n = sock_write_file(sock, fp, offset, len);
+		if (n <= 0)
+			return -1;
+		len -= n;
+		wrlen += n;
+		offset += n;
+	}
+
+	return wrlen;
+}
+
 #if USE_SSL
 gint ssl_write_all(SSL *ssl, const gchar *buf, gint len)
 {
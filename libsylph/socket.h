@@ -25,6 +25,7 @@
 #endif
 
 #include <glib.h>
+#include <stdio.h>
 #if HAVE_NETDB_H
 #  include <netdb.h>
 #endif
@@ -115,6 +116,8 @@ gint sock_printf	(SockInfo *sock, const gchar *format, ...)
 gint sock_read		(SockInfo *sock, gchar *buf, gint len);
 gint sock_write		(SockInfo *sock, const gchar *buf, gint len);
 gint sock_write_all	(SockInfo *sock, const gchar *buf, gint len);
+gint sock_write_file	(SockInfo *sock, FILE *fp, gint offset, gint len);
+gint sock_write_file_all(SockInfo *sock, FILE *fp, gint offset, gint len);
 gint sock_gets		(SockInfo *sock, gchar *buf, gint len);
 gint sock_getline	(SockInfo *sock, gchar **line);
 gint sock_puts		(SockInfo *sock, const gchar *buf);
@@ -40,6 +40,7 @@
 #include "account.h"
 #include "filter.h"
 #include "folder.h"
+#include "procmime.h"
 #include "socket.h"
 #include "codeconv.h"
 #include "utils.h"
@@ -318,6 +319,7 @@ gint syl_setup_rc_dir(void)
 void syl_save_all_state(void)
 {
 	folder_write_list();
+	procmime_write_all_mime_caches();
 	prefs_common_write_config();
 	filter_write_config();
 	account_write_config_all();
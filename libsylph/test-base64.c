@@ -0,0 +1,123 @@
+/*
+ * LibSylph -- E-Mail client library
+ * Copyright (C) 1999-2005 Hiroyuki Yamamoto
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Checks that base64_encoder_encode() never writes beyond
+   BASE64_ENCODER_OUTLEN(inlen) bytes in any encoder state (every line
+   length and number of pending bytes), and that the output decodes back
+   to the input. */
+
+#include <glib.h>
+#include <string.h>
+
+#include "base64.h"
+
+#define MAX_INLEN	400
+#define GUARD_LEN	16
+#define GUARD_CHAR	'\xa5'
+#define BUFFSIZE	8192
+
+static guchar inbuf[BUFFSIZE + BASE64_LINE_LENGTH];
+
+static gboolean test_encode(gint line_len, gint pending, gint inlen)
+{
+	Base64Encoder *encoder;
+	GString *encoded;
+	gchar *out;
+	guchar *decoded;
+	gint outlen, maxlen, prefix, dlen, i;
+	gboolean ret = TRUE;
+
+	encoder = base64_encoder_new();
+	encoded = g_string_new(NULL);
+
+	/* bring the encoder into the state (line_len, pending) */
+	prefix = line_len / 4 * 3 + pending;
+	out = g_malloc(BASE64_ENCODER_OUTLEN(prefix));
+	outlen = base64_encoder_encode(encoder, inbuf, prefix, out);
+	g_string_append_len(encoded, out, outlen);
+	g_free(out);
+	if (encoder->line_len != line_len || encoder->buf_len != pending) {
+		g_print("can't set state (%d, %d)\n", line_len, pending);
+		ret = FALSE;
+	}
+
+	maxlen = BASE64_ENCODER_OUTLEN(inlen);
+	out = g_malloc(maxlen + GUARD_LEN);
+	memset(out, GUARD_CHAR, maxlen + GUARD_LEN);
+	outlen = base64_encoder_encode(encoder, inbuf + prefix, inlen, out);
+	for (i = maxlen; i < maxlen + GUARD_LEN; i++) {
+		if (out[i] != GUARD_CHAR) {
+			g_print("line_len %d, pending %d, inlen %d: "
+				"wrote beyond %d bytes\n",
+				line_len, pending, inlen, maxlen);
+			ret = FALSE;
+			break;
+		}
+	}
+	g_string_append_len(encoded, out, outlen);
+	g_free(out);
+
+	out = g_malloc(6);
+	outlen = base64_encoder_flush(encoder, out);
+	g_string_append_len(encoded, out, outlen);
+	g_free(out);
+
+	/* decode line by line */
+	decoded = g_malloc(encoded->len);
+	dlen = 0;
+	for (i = 0; i < (gint)encoded->len; i += BASE64_LINE_LENGTH + 1) {
+		gint len = MIN(BASE64_LINE_LENGTH, (gint)encoded->len - i - 1);
+
+		dlen += base64_decode(decoded + dlen, encoded->str + i, len);
+	}
+	if (dlen != prefix + inlen || memcmp(decoded, inbuf, dlen) != 0) {
+		g_print("line_len %d, pending %d, inlen %d: "
+			"decoded data differs\n", line_len, pending, inlen);
+		ret = FALSE;
+	}
+	g_free(decoded);
+
+	g_string_free(encoded, TRUE);
+	base64_encoder_free(encoder);
+
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	gint line_len, pending, inlen, i;
+	gboolean ret = TRUE;
+
+	for (i = 0; i < (gint)sizeof(inbuf); i++)
+		inbuf[i] = (guchar)(i * 7 + i / 251);
+
+	for (line_len = 0; line_len < BASE64_LINE_LENGTH; line_len += 4) {
+		for (pending = 0; pending < 3; pending++) {
+			for (inlen = 0; inlen <= MAX_INLEN; inlen++) {
+				if (!test_encode(line_len, pending, inlen))
+					ret = FALSE;
+			}
+			/* the chunk size used by compose_write_attach() */
+			if (!test_encode(line_len, pending, BUFFSIZE))
+				ret = FALSE;
+		}
+	}
+
+	return ret ? 0 : 1;
+}
@@ -0,0 +1,423 @@
+/*
+ * LibSylph -- E-Mail client library
+ * Copyright (C) 1999-2009 Hiroyuki Yamamoto
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Gets the overview of a newsgroup from a local NNTP stand-in server and
+   checks the article list. The stand-in server runs in a child process
+   and serves articles 1000, 2000, ..., 12000 (three overview chunks). */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include "defs.h"
+
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#ifndef G_OS_WIN32
+#  include <unistd.h>
+#  include <sys/types.h>
+#  include <sys/socket.h>
+#  include <sys/wait.h>
+#  include <netinet/in.h>
+#  include <arpa/inet.h>
+#endif
+
+#if HAVE_LIBZ
+#  include <zlib.h>
+#endif
+
+#include "sylmain.h"
+#include "folder.h"
+#include "news.h"
+#include "nntp.h"
+#include "procmsg.h"
+#include "prefs_common.h"
+#include "prefs_account.h"
+#include "utils.h"
+
+#define TEST_GROUP		"test.group"
+#define TEST_LAST		12000
+#define TEST_INTERVAL		1000
+
+typedef enum
+{
+	SERVER_NO_XZVER,	/* XZVER is an unknown command */
+	SERVER_EMPTY_FIRST,	/* no articles in the first chunk */
+	SERVER_BROKEN_XZVER	/* broken compressed data in the 2nd chunk */
+} ServerMode;
+
+#ifndef G_OS_WIN32
+
+static gboolean article_exists(ServerMode mode, gint num)
+{
+	if (num < 1 || num > TEST_LAST || num % TEST_INTERVAL != 0)
+		return FALSE;
+	if (mode == SERVER_EMPTY_FIRST && num <= 5000)
+		return FALSE;
+	return TRUE;
+}
+
+static void server_write(gint fd, const gchar *str)
+{
+	if (write(fd, str, strlen(str)) < 0)
+		_exit(1);
+}
+
+static GString *server_get_overview(ServerMode mode, gint first, gint last)
+{
+	GString *str;
+	gint num;
+
+	str = g_string_new(NULL);
+
+	for (num = first; num <= last; num++) {
+		if (!article_exists(mode, num))
+			continue;
+		g_string_append_printf
+			(str, "%d\tsubject %d\tfrom-%d@example.com\t"
+			 "Mon, 19 Oct 2026 10:00:00 +0000\t<%d@example.com>\t"
+			 "\t1000\t10\r\n", num, num, num, num);
+	}
+
+	return str;
+}
+
+#if HAVE_LIBZ
+/* deflate and yEnc encode the data as XZVER does */
+static void server_write_compressed(gint fd, const GString *data)
+{
+	z_stream zs;
+	guchar *out;
+	uLong out_len;
+	GString *line;
+	guchar c;
+	uLong i;
+
+	memset(&zs, 0, sizeof(zs));
+	if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS,
+			 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		_exit(1);
+	out_len = deflateBound(&zs, data->len);
+	out = g_malloc(out_len);
+	zs.next_in = (Bytef *)data->str;
+	zs.avail_in = data->len;
+	zs.next_out = out;
+	zs.avail_out = out_len;
+	if (deflate(&zs, Z_FINISH) != Z_STREAM_END)
+		_exit(1);
+	out_len = zs.total_out;
+	deflateEnd(&zs);
+
+	server_write(fd, "224 compressed overview follows\r\n");
+	server_write(fd, "=ybegin line=128 size=0 name=xzver\r\n");
+
+	line = g_string_new(NULL);
+	for (i = 0; i < out_len; i++) {
+		c = (guchar)(out[i] + 42);
+		if (c == '\0' || c == '\n' || c == '\r' || c == '=') {
+			g_string_append_c(line, '=');
+			c = (guchar)(c + 64);
+		}
+		if (line->len == 0 && c == '.')
+			g_string_append_c(line, '.');
+		g_string_append_c(line, c);
+		if (line->len >= 128 || i == out_len - 1) {
+			g_string_append(line, "\r\n");
+			server_write(fd, line->str);
+			g_string_truncate(line, 0);
+		}
+	}
+	g_string_free(line, TRUE);
+	g_free(out);
+
+	server_write(fd, "=yend size=0\r\n.\r\n");
+}
+#endif /* HAVE_LIBZ */
+
+static gboolean server_has_articles(ServerMode mode, gint first, gint last)
+{
+	gint num;
+
+	for (num = first; num <= last; num++) {
+		if (article_exists(mode, num))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+static void server_overview(gint fd, ServerMode mode, gint first, gint last,
+			    gboolean compress)
+{
+	GString *str;
+
+	if (compress && mode == SERVER_NO_XZVER) {
+		server_write(fd, "500 unknown command\r\n");
+		return;
+	}
+	if (!server_has_articles(mode, first, last)) {
+		server_write(fd, "423 no articles in that range\r\n");
+		return;
+	}
+#if HAVE_LIBZ
+	if (compress && mode == SERVER_BROKEN_XZVER && first == 5001) {
+		server_write(fd, "224 compressed overview follows\r\n"
+			     "=ybegin line=128 size=16 name=xzver\r\n"
+			     "abcdefghijklmnop\r\n"
+			     "=yend size=16\r\n.\r\n");
+		return;
+	}
+#endif
+
+	str = server_get_overview(mode, first, last);
+#if HAVE_LIBZ
+	if (compress) {
+		server_write_compressed(fd, str);
+		g_string_free(str, TRUE);
+		return;
+	}
+#endif
+	server_write(fd, "224 overview follows\r\n");
+	server_write(fd, str->str);
+	server_write(fd, ".\r\n");
+	g_string_free(str, TRUE);
+}
+
+static void server_xhdr(gint fd, ServerMode mode, const gchar *header,
+			gint first, gint last)
+{
+	gchar buf[256];
+	gint num;
+
+	server_write(fd, "221 header follows\r\n");
+	if (!g_ascii_strcasecmp(header, "to")) {
+		for (num = first; num <= last; num++) {
+			if (!article_exists(mode, num))
+				continue;
+			g_snprintf(buf, sizeof(buf),
+				   "%d to-%d@example.com\r\n", num, num);
+			server_write(fd, buf);
+		}
+	}
+	server_write(fd, ".\r\n");
+}
+
+static void server_run(gint fd, ServerMode mode)
+{
+	FILE *fp;
+	gchar buf[1024];
+	gchar header[64];
+	gint first, last;
+	gchar *reply;
+
+	if ((fp = fdopen(dup(fd), "r")) == NULL)
+		_exit(1);
+
+	server_write(fd, "200 NNTP stand-in ready\r\n");
+
+	while (fgets(buf, sizeof(buf), fp) != NULL) {
+		strretchomp(buf);
+		if (!g_ascii_strncasecmp(buf, "GROUP ", 6)) {
+			reply = g_strdup_printf("211 %d 1 %d %s\r\n",
+						TEST_LAST / TEST_INTERVAL,
+						TEST_LAST, TEST_GROUP);
+			server_write(fd, reply);
+			g_free(reply);
+		} else if (sscanf(buf, "XOVER %d-%d", &first, &last) == 2)
+			server_overview(fd, mode, first, last, FALSE);
+		else if (sscanf(buf, "XZVER %d-%d", &first, &last) == 2)
+			server_overview(fd, mode, first, last, TRUE);
+		else if (sscanf(buf, "XHDR %63s %d-%d",
+				header, &first, &last) == 3)
+			server_xhdr(fd, mode, header, first, last);
+		else if (!g_ascii_strncasecmp(buf, "MODE ", 5))
+			server_write(fd, "200 reading allowed\r\n");
+		else if (!g_ascii_strcasecmp(buf, "QUIT")) {
+			server_write(fd, "205 bye\r\n");
+			break;
+		} else
+			server_write(fd, "500 unknown command\r\n");
+	}
+
+	fclose(fp);
+	close(fd);
+	_exit(0);
+}
+
+static gint server_start(ServerMode mode, gushort *port, pid_t *pid)
+{
+	struct sockaddr_in addr;
+	socklen_t len;
+	gint sock, fd;
+
+	if ((sock = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+		perror("socket");
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0;
+	len = sizeof(addr);
+	if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+	    listen(sock, 1) < 0 ||
+	    getsockname(sock, (struct sockaddr *)&addr, &len) < 0) {
+		perror("bind");
+		close(sock);
+		return -1;
+	}
+	*port = ntohs(addr.sin_port);
+
+	if ((*pid = fork()) < 0) {
+		perror("fork");
+		close(sock);
+		return -1;
+	}
+	if (*pid == 0) {
+		if ((fd = accept(sock, NULL, NULL)) < 0)
+			_exit(1);
+		close(sock);
+		server_run(fd, mode);
+	}
+
+	close(sock);
+	return 0;
+}
+
+static gboolean test_overview(ServerMode mode, const gchar *name,
+			      gboolean xzver_failed)
+{
+	PrefsAccount *ac;
+	Folder *folder;
+	FolderItem *item;
+	NNTPSession *session;
+	GSList *mlist, *cur;
+	gushort port;
+	pid_t pid;
+	gint num, status;
+	gchar *to;
+	gboolean ret = TRUE;
+
+	if (server_start(mode, &port, &pid) < 0)
+		return FALSE;
+
+	ac = g_new0(PrefsAccount, 1);
+	ac->nntp_server = g_strdup("127.0.0.1");
+	ac->set_nntpport = TRUE;
+	ac->nntpport = port;
+
+	folder = folder_new(F_NEWS, name, ac->nntp_server);
+	folder->account = ac;
+	item = folder_item_new(TEST_GROUP, TEST_GROUP);
+	folder_item_append(FOLDER_ITEM(folder->node->data), item);
+	/* don't write the cache */
+	item->opened = TRUE;
+
+	mlist = folder_item_get_msg_list(item, FALSE);
+	mlist = procmsg_sort_msg_list(mlist, SORT_BY_NUMBER, SORT_ASCENDING);
+
+	num = TEST_INTERVAL;
+	while (!article_exists(mode, num))
+		num += TEST_INTERVAL;
+	for (cur = mlist; cur != NULL; cur = cur->next, num += TEST_INTERVAL) {
+		MsgInfo *msginfo = (MsgInfo *)cur->data;
+
+		to = g_strdup_printf("to-%d@example.com", num);
+		if (msginfo->msgnum != num ||
+		    !msginfo->to || strcmp(msginfo->to, to) != 0) {
+			g_print("%s: unexpected article %u (to: %s)\n",
+				name, msginfo->msgnum,
+				msginfo->to ? msginfo->to : "(null)");
+			ret = FALSE;
+		}
+		g_free(to);
+	}
+	if (num != TEST_LAST + TEST_INTERVAL) {
+		g_print("%s: got %d articles\n", name,
+			g_slist_length(mlist));
+		ret = FALSE;
+	}
+
+	session = NNTP_SESSION(REMOTE_FOLDER(folder)->session);
+	if (!session) {
+		g_print("%s: session was closed\n", name);
+		ret = FALSE;
+	} else {
+#if HAVE_LIBZ
+		if (session->xzver_failed != xzver_failed) {
+			g_print("%s: xzver_failed is %d\n", name,
+				session->xzver_failed);
+			ret = FALSE;
+		}
+#endif
+		session_destroy(SESSION(session));
+		REMOTE_FOLDER(folder)->session = NULL;
+	}
+
+	procmsg_msg_list_free(mlist);
+
+	if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+	    WEXITSTATUS(status) != 0) {
+		g_print("%s: stand-in server failed\n", name);
+		ret = FALSE;
+	}
+
+	g_print("%s: %s\n", name, ret ? "ok" : "FAILED");
+
+	return ret;
+}
+
+#endif /* G_OS_WIN32 */
+
+int main(int argc, char *argv[])
+{
+#ifdef G_OS_WIN32
+	/* skipped */
+	return 77;
+#else
+	gchar *rc_dir;
+	gboolean ret = TRUE;
+
+	syl_init();
+
+	rc_dir = g_strdup_printf("%s%ctest-news-%d", g_get_tmp_dir(),
+				 G_DIR_SEPARATOR, (gint)getpid());
+	set_rc_dir(rc_dir);
+	if (make_dir_hier(rc_dir) < 0)
+		return 1;
+
+	prefs_common.online_mode = TRUE;
+
+	if (!test_overview(SERVER_NO_XZVER, "no-xzver", TRUE))
+		ret = FALSE;
+	if (!test_overview(SERVER_EMPTY_FIRST, "empty-first-chunk", FALSE))
+		ret = FALSE;
+	if (!test_overview(SERVER_BROKEN_XZVER, "broken-xzver", FALSE))
+		ret = FALSE;
+
+	remove_dir_recursive(rc_dir);
+	g_free(rc_dir);
+
+	return ret ? 0 : 1;
+#endif
+}
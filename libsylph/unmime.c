@@ -46,6 +46,10 @@ gchar *unmime_header(const gchar *encoded_str)
 	gchar *out_str;
 	gsize out_len;
 
+	/* nothing to decode */
+	if (!strstr(encoded_str, ENCODED_WORD_BEGIN))
+		return g_strdup(encoded_str);
+
 	outbuf = g_string_sized_new(strlen(encoded_str) * 2);
 
 	while (*p != '\0') {
@@ -660,11 +660,14 @@ void trim_subject_for_compare(gchar *str)
 	eliminate_parenthesis(str, '(', ')');
 	g_strstrip(str);
 
-	while (!g_ascii_strncasecmp(str, "Re:", 3)) {
-		srcp = str + 3;
+	/* skip all the "Re:" first and move the rest only once */
+	srcp = str;
+	while (!g_ascii_strncasecmp(srcp, "Re:", 3)) {
+		srcp += 3;
 		while (g_ascii_isspace(*srcp)) srcp++;
-		memmove(str, srcp, strlen(srcp) + 1);
 	}
+	if (srcp != str)
+		memmove(str, srcp, strlen(srcp) + 1);
 }
 
 void trim_subject_for_sort(gchar *str)
@@ -673,11 +676,14 @@ void trim_subject_for_sort(gchar *str)
 
 	g_strstrip(str);
 
-	while (!g_ascii_strncasecmp(str, "Re:", 3)) {
-		srcp = str + 3;
+	/* skip all the "Re:" first and move the rest only once */
+	srcp = str;
+	while (!g_ascii_strncasecmp(srcp, "Re:", 3)) {
+		srcp += 3;
 		while (g_ascii_isspace(*srcp)) srcp++;
-		memmove(str, srcp, strlen(srcp) + 1);
 	}
+	if (srcp != str)
+		memmove(str, srcp, strlen(srcp) + 1);
 }
 
 void trim_subject(gchar *str)
@@ -1344,11 +1350,31 @@ gboolean is_header_line(const gchar *str)
 	return FALSE;
 }
 
+/* word-at-a-time byte tests (see "Bit Twiddling Hacks") */
+#define WORD_ONES		((gulong)-1 / 0xff)
+#define WORD_HIGHS		(WORD_ONES * 0x80)
+#define WORD_HAS_LESS(w, n)	(((w) - WORD_ONES * (n)) & ~(w) & WORD_HIGHS)
+#define WORD_HAS_ZERO(w)	WORD_HAS_LESS(w, 1)
+#define WORD_IS_ALIGNED(p)	(((gsize)(p) & (sizeof(gulong) - 1)) == 0)
+
 gboolean is_ascii_str(const gchar *str)
 {
 	const guchar *p = (const guchar *)str;
+	gulong w;
+
+	for (;;) {
+		/* skip printable characters a word at a time */
+		if (WORD_IS_ALIGNED(p)) {
+			memcpy(&w, p, sizeof(w));
+			if (!WORD_HAS_LESS(w, 32) && (w & WORD_HIGHS) == 0 &&
+			    !WORD_HAS_ZERO(w ^ (WORD_ONES * 127))) {
+				p += sizeof(w);
+				continue;
+			}
+		}
 
-	while (*p != '\0') {
+		if (*p == '\0')
+			break;
 		if (*p != '\t' && *p != ' ' &&
 		    *p != '\r' && *p != '\n' &&
 		    (*p < 32 || *p >= 127))
@@ -1359,6 +1385,75 @@ gboolean is_ascii_str(const gchar *str)
 	return TRUE;
 }
 
+/* returns the first non-ASCII byte or the terminating NUL */
+static const guchar *skip_7bit(const guchar *p)
+{
+	gulong w;
+
+	while (!WORD_IS_ALIGNED(p)) {
+		if (*p == '\0' || *p >= 0x80)
+			return p;
+		p++;
+	}
+
+	for (;;) {
+		memcpy(&w, p, sizeof(w));
+		if (WORD_HAS_ZERO(w) || (w & WORD_HIGHS) != 0)
+			break;
+		p += sizeof(w);
+	}
+
+	while (*p != '\0' && *p < 0x80)
+		p++;
+
+	return p;
+}
+
+/* same as g_utf8_validate(str, -1, NULL), but runs of ASCII characters
+   are skipped a word at a time */
+gboolean is_utf8_str(const gchar *str)
+{
+	const guchar *p = (const guchar *)str;
+	gint len, i;
+
+	for (;;) {
+		p = skip_7bit(p);
+		if (*p == '\0')
+			return TRUE;
+
+		if (*p < 0xc2)
+			return FALSE;
+		else if (*p < 0xe0)
+			len = 1;
+		else if (*p < 0xf0)
+			len = 2;
+		else if (*p < 0xf5)
+			len = 3;
+		else
+			return FALSE;
+
+		/* overlong forms, surrogates and code points over U+10FFFF */
+		if ((*p == 0xe0 && p[1] < 0xa0) ||
+		    (*p == 0xed && p[1] >= 0xa0) ||
+		    (*p == 0xf0 && p[1] < 0x90) ||
+		    (*p == 0xf4 && p[1] >= 0x90))
+			return FALSE;
+
+		/* NUL is not a continuation byte, so this does not overrun */
+		for (i = 1; i <= len; i++) {
+			if ((p[i] & 0xc0) != 0x80)
+				return FALSE;
+		}
+		p += len + 1;
+	}
+}
+
+#undef WORD_IS_ALIGNED
+#undef WORD_HAS_ZERO
+#undef WORD_HAS_LESS
+#undef WORD_HIGHS
+#undef WORD_ONES
+
 gint get_quote_level(const gchar *str)
 {
 	const gchar *first_pos;
@@ -3461,6 +3556,11 @@ gchar *strchomp_all(const gchar *str)
 }
 
 FILE *get_outgoing_rfc2822_file(FILE *fp)
+{
+	return get_outgoing_rfc2822_file_full(fp, TRUE);
+}
+
+FILE *get_outgoing_rfc2822_file_full(FILE *fp, gboolean dot_stuffing)
 {
 	gchar buf[BUFFSIZE];
 	FILE *outfp;
@@ -3501,7 +3601,7 @@ FILE *get_outgoing_rfc2822_file(FILE *fp)
 	/* output body part */
 	while (fgets(buf, sizeof(buf), fp) != NULL) {
 		strretchomp(buf);
-		if (buf[0] == '.') {
+		if (dot_stuffing && buf[0] == '.') {
 			if (fputc('.', outfp) == EOF)
 				goto file_error;
 		}
@@ -3525,6 +3625,59 @@ file_error:
 	return NULL;
 }
 
+/* apply the SMTP transparency procedure (RFC 5321 4.5.2) to
+   CRLF-canonicalized data */
+FILE *dot_stuff_file_stream(FILE *src_fp, gint *length)
+{
+	FILE *dest_fp;
+	gchar buf[BUFFSIZE];
+	gint len;
+	gint length_ = 0;
+	gboolean line_head = TRUE;
+
+	if ((dest_fp = my_tmpfile()) == NULL) {
+		FILE_OP_ERROR("dot_stuff_file_stream", "my_tmpfile");
+		return NULL;
+	}
+
+	while (fgets(buf, sizeof(buf), src_fp) != NULL) {
+		len = strlen(buf);
+		if (len == 0) break;
+
+		if (line_head && buf[0] == '.') {
+			if (fputc('.', dest_fp) == EOF)
+				goto file_error;
+			length_++;
+		}
+		if (fputs(buf, dest_fp) == EOF)
+			goto file_error;
+		length_ += len;
+
+		line_head = (buf[len - 1] == '\n');
+	}
+
+	if (ferror(src_fp)) {
+		FILE_OP_ERROR("dot_stuff_file_stream", "fgets");
+		fclose(dest_fp);
+		return NULL;
+	}
+	if (fflush(dest_fp) == EOF) {
+		FILE_OP_ERROR("dot_stuff_file_stream", "fflush");
+		goto file_error;
+	}
+
+	if (length)
+		*length = length_;
+
+	rewind(dest_fp);
+	return dest_fp;
+
+file_error:
+	g_warning("dot_stuff_file_stream(): writing to temporary file failed.\n");
+	fclose(dest_fp);
+	return NULL;
+}
+
 gchar *get_outgoing_rfc2822_str(FILE *fp)
 {
 	gchar buf[BUFFSIZE];
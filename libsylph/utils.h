@@ -342,6 +342,7 @@ gchar *get_alt_filename			(const gchar	*filename,
 
 gboolean is_header_line			(const gchar	*str);
 gboolean is_ascii_str			(const gchar	*str);
+gboolean is_utf8_str			(const gchar	*str);
 
 gint get_quote_level			(const gchar	*str);
 gint check_line_length			(const gchar	*str,
@@ -473,6 +474,11 @@ gchar *normalize_newlines	(const gchar	*str);
 gchar *strchomp_all		(const gchar	*str);
 
 FILE *get_outgoing_rfc2822_file	(FILE		*fp);
+FILE *get_outgoing_rfc2822_file_full
+				(FILE		*fp,
+				 gboolean	 dot_stuffing);
+FILE *dot_stuff_file_stream	(FILE		*fp,
+				 gint		*length);
 gchar *get_outgoing_rfc2822_str	(FILE		*fp);
 gchar *generate_mime_boundary	(const gchar	*prefix);
 
@@ -51,6 +51,7 @@ struct _VirtualSearchInfo {
 	GHashTable *search_cache_table;
 	FILE *fp;
 	gboolean requires_full_headers;
+	gchar **header_names;
 	gboolean exclude_trash;
 };
 
@@ -397,17 +398,19 @@ static GSList *virtual_search_folder(VirtualSearchInfo *info, FolderItem *item)
 		}
 
 		fltinfo.flags = msginfo->flags;
-		if (info->requires_full_headers) {
+		if (info->header_names) {
+			hlist = procheader_get_header_list_from_msginfo_full
+				(msginfo, info->header_names);
+		} else if (info->requires_full_headers) {
 			gchar *file;
 
 			file = procmsg_get_message_file(msginfo);
 			hlist = procheader_get_header_list_from_file(file);
 			g_free(file);
+			if (!hlist)
+				continue;
 		} else
-			hlist = procheader_get_header_list_from_msginfo
-				(msginfo);
-		if (!hlist)
-			continue;
+			hlist = NULL;
 
 		if (filter_match_rule(info->rule, msginfo, hlist, &fltinfo)) {
 			match_list = g_slist_prepend(match_list, msginfo);
@@ -506,6 +509,10 @@ static GSList *virtual_get_msg_list(Folder *folder, FolderItem *item,
 
 	info.requires_full_headers =
 		filter_rule_requires_full_headers(rule);
+	if (info.requires_full_headers)
+		info.header_names = filter_rule_get_required_headers(rule);
+	else
+		info.header_names = NULL;
 
 	if (rule->recursive) {
 		if (target->stype == F_TRASH)
@@ -524,6 +531,7 @@ static GSList *virtual_get_msg_list(Folder *folder, FolderItem *item,
 
 	fclose(info.fp);
 	virtual_search_cache_free(info.search_cache_table);
+	g_strfreev(info.header_names);
 
 	for (cur = mlist; cur != NULL; cur = cur->next) {
 		MsgInfo *msginfo = (MsgInfo *)cur->data;
@@ -167,9 +167,6 @@ typedef enum
 	COMPOSE_ACTION_DELETE_TO_LINE_END
 } ComposeAction;
 
-#define B64_LINE_SIZE		57
-#define B64_BUFFSIZE		77
-
 #define MAX_REFERENCES_LEN	999
 
 #define TEXTVIEW_MARGIN		6
@@ -3955,15 +3952,18 @@ static gint compose_write_to_file(Compose *compose, const gchar *file,
 	/* write body */
 	len = strlen(buf);
 	if (encoding == ENC_BASE64) {
-		gchar outbuf[B64_BUFFSIZE];
-		gint i, l;
-
-		for (i = 0; i < len; i += B64_LINE_SIZE) {
-			l = MIN(B64_LINE_SIZE, len - i);
-			base64_encode(outbuf, (guchar *)buf + i, l);
-			fputs(outbuf, fp);
-			fputc('\n', fp);
-		}
+		Base64Encoder *encoder;
+		gchar *outbuf;
+		gint outlen;
+
+		encoder = base64_encoder_new();
+		outbuf = g_malloc(BASE64_ENCODER_OUTLEN(len) + 6);
+		outlen = base64_encoder_encode(encoder, (guchar *)buf, len,
+					       outbuf);
+		outlen += base64_encoder_flush(encoder, outbuf + outlen);
+		fwrite(outbuf, sizeof(gchar), outlen, fp);
+		g_free(outbuf);
+		base64_encoder_free(encoder);
 	} else if (encoding == ENC_QUOTED_PRINTABLE) {
 		gchar *outbuf;
 		size_t outlen;
@@ -4469,7 +4469,10 @@ static gint compose_write_attach(Compose *compose, FILE *fp,
 			procmime_get_encoding_str(encoding));
 
 		if (encoding == ENC_BASE64) {
-			gchar inbuf[B64_LINE_SIZE], outbuf[B64_BUFFSIZE];
+			Base64Encoder *encoder;
+			guchar inbuf[BUFFSIZE];
+			gchar outbuf[BASE64_ENCODER_OUTLEN(BUFFSIZE)];
+			gint outlen;
 			FILE *tmp_fp = attach_fp;
 			gchar *tmp_file = NULL;
 			ContentType content_type;
@@ -4494,19 +4497,16 @@ static gint compose_write_attach(Compose *compose, FILE *fp,
 				}
 			}
 
-			while ((len = fread(inbuf, sizeof(gchar),
-					    B64_LINE_SIZE, tmp_fp))
-			       == B64_LINE_SIZE) {
-				base64_encode(outbuf, (guchar *)inbuf,
-					      B64_LINE_SIZE);
-				fputs(outbuf, fp);
-				fputc('\n', fp);
-			}
-			if (len > 0 && feof(tmp_fp)) {
-				base64_encode(outbuf, (guchar *)inbuf, len);
-				fputs(outbuf, fp);
-				fputc('\n', fp);
+			encoder = base64_encoder_new();
+			while ((len = fread(inbuf, sizeof(guchar),
+					    sizeof(inbuf), tmp_fp)) > 0) {
+				outlen = base64_encoder_encode(encoder, inbuf,
+							       len, outbuf);
+				fwrite(outbuf, sizeof(gchar), outlen, fp);
 			}
+			outlen = base64_encoder_flush(encoder, outbuf);
+			fwrite(outbuf, sizeof(gchar), outlen, fp);
+			base64_encoder_free(encoder);
 
 			if (tmp_file) {
 				fclose(tmp_fp);
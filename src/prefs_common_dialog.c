@@ -261,6 +261,9 @@ static struct Advanced {
 
 	GtkWidget *spinbtn_iotimeout;
 	GtkObject *spinbtn_iotimeout_adj;
+
+	GtkWidget *spinbtn_smtp_conn;
+	GtkObject *spinbtn_smtp_conn_adj;
 } advanced;
 
 static struct MessageColorButtons {
@@ -604,6 +607,8 @@ static PrefsUIData ui_data[] = {
 	 prefs_set_data_from_toggle, prefs_set_toggle},
 	{"io_timeout_secs", &advanced.spinbtn_iotimeout,
 	 prefs_set_data_from_spinbtn, prefs_set_spinbtn},
+	{"smtp_max_connections", &advanced.spinbtn_smtp_conn,
+	 prefs_set_data_from_spinbtn, prefs_set_spinbtn},
 
 	{NULL, NULL, NULL, NULL}
 };
@@ -2918,6 +2923,10 @@ static GtkWidget *prefs_advanced_create(void)
 	GtkWidget *spinbtn_iotimeout;
 	GtkObject *spinbtn_iotimeout_adj;
 
+	GtkWidget *label_smtp_conn;
+	GtkWidget *spinbtn_smtp_conn;
+	GtkObject *spinbtn_smtp_conn_adj;
+
 	vbox1 = gtk_vbox_new (FALSE, VSPACING);
 	gtk_widget_show (vbox1);
 
@@ -2953,6 +2962,24 @@ static GtkWidget *prefs_advanced_create(void)
 	gtk_widget_show (label_iotimeout);
 	gtk_box_pack_start (GTK_BOX (hbox1), label_iotimeout, FALSE, FALSE, 0);
 
+	hbox1 = gtk_hbox_new (FALSE, 8);
+	gtk_widget_show (hbox1);
+	gtk_box_pack_start (GTK_BOX (vbox1), hbox1, FALSE, FALSE, 0);
+
+	label_smtp_conn = gtk_label_new
+		(_("Maximum number of SMTP connections per server:"));
+	gtk_widget_show (label_smtp_conn);
+	gtk_box_pack_start (GTK_BOX (hbox1), label_smtp_conn, FALSE, FALSE, 0);
+
+	spinbtn_smtp_conn_adj = gtk_adjustment_new (2, 1, 16, 1, 1, 0);
+	spinbtn_smtp_conn = gtk_spin_button_new
+		(GTK_ADJUSTMENT (spinbtn_smtp_conn_adj), 1, 0);
+	gtk_widget_show (spinbtn_smtp_conn);
+	gtk_box_pack_start (GTK_BOX (hbox1), spinbtn_smtp_conn,
+			    FALSE, FALSE, 0);
+	gtk_widget_set_size_request (spinbtn_smtp_conn, 64, -1);
+	gtk_spin_button_set_numeric (GTK_SPIN_BUTTON (spinbtn_smtp_conn), TRUE);
+
 	vbox2 = gtk_vbox_new (FALSE, VSPACING_NARROW);
 	gtk_widget_show (vbox2);
 	gtk_box_pack_start (GTK_BOX (vbox1), vbox2, FALSE, FALSE, 0);
@@ -2962,6 +2989,9 @@ static GtkWidget *prefs_advanced_create(void)
 	advanced.spinbtn_iotimeout     = spinbtn_iotimeout;
 	advanced.spinbtn_iotimeout_adj = spinbtn_iotimeout_adj;
 
+	advanced.spinbtn_smtp_conn     = spinbtn_smtp_conn;
+	advanced.spinbtn_smtp_conn_adj = spinbtn_smtp_conn_adj;
+
 	return vbox1;
 }
 
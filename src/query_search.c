@@ -102,6 +102,7 @@ static struct QuerySearchWindow {
 
 	FilterRule *rule;
 	gboolean requires_full_headers;
+	gchar **header_names;
 
 	gboolean exclude_trash;
 
@@ -513,6 +514,9 @@ static void query_search_query(void)
 	}
 	search_window.requires_full_headers =
 		filter_rule_requires_full_headers(search_window.rule);
+	if (search_window.requires_full_headers)
+		search_window.header_names =
+			filter_rule_get_required_headers(search_window.rule);
 
 	if (search_window.rule->recursive) {
 		if (item->stype == F_TRASH)
@@ -539,6 +543,8 @@ static void query_search_query(void)
 	filter_rule_free(search_window.rule);
 	search_window.rule = NULL;
 	search_window.requires_full_headers = FALSE;
+	g_strfreev(search_window.header_names);
+	search_window.header_names = NULL;
 	search_window.exclude_trash = FALSE;
 
 	gtk_widget_set_sensitive(search_window.clear_btn, TRUE);
@@ -655,17 +661,19 @@ static gpointer query_search_folder_func(gpointer data)
 			break;
 
 		fltinfo.flags = msginfo->flags;
-		if (search_window.requires_full_headers) {
+		if (search_window.header_names) {
+			hlist = procheader_get_header_list_from_msginfo_full
+				(msginfo, search_window.header_names);
+		} else if (search_window.requires_full_headers) {
 			gchar *file;
 
 			file = procmsg_get_message_file(msginfo);
 			hlist = procheader_get_header_list_from_file(file);
 			g_free(file);
+			if (!hlist)
+				continue;
 		} else
-			hlist = procheader_get_header_list_from_msginfo
-				(msginfo);
-		if (!hlist)
-			continue;
+			hlist = NULL;
 
 		if (filter_match_rule(search_window.rule, msginfo, hlist,
 				      &fltinfo)) {
@@ -51,9 +51,19 @@ static const struct {
 	{QS_IN_ADDRESSBOOK,	-1}
 };
 
+typedef struct _QSearchIndexEntry
+{
+	MsgInfo *msginfo;
+	const gchar *text;
+} QSearchIndexEntry;
+
 static GdkColor text_color;
 static GdkColor dim_color = {0, COLOR_DIM, COLOR_DIM, COLOR_DIM};
 
+static void quick_search_build_index	(QuickSearch	*qsearch);
+static GArray *quick_search_match_key	(QuickSearch	*qsearch,
+					 const gchar	*key);
+
 static void menu_activated		(GtkWidget	*menuitem,
 					 QuickSearch	*qsearch);
 static gboolean entry_focus_in		(GtkWidget	*entry,
@@ -206,13 +216,133 @@ void quick_search_clear_entry(QuickSearch *qsearch)
 	gtk_widget_hide(qsearch->clear_btn);
 }
 
+void quick_search_clear_index(QuickSearch *qsearch)
+{
+	if (qsearch->index) {
+		g_array_free(qsearch->index, TRUE);
+		qsearch->index = NULL;
+	}
+	if (qsearch->index_chunk) {
+		g_string_chunk_free(qsearch->index_chunk);
+		qsearch->index_chunk = NULL;
+	}
+	qsearch->index_item = NULL;
+
+	g_free(qsearch->prev_key);
+	qsearch->prev_key = NULL;
+	if (qsearch->prev_match) {
+		g_array_free(qsearch->prev_match, TRUE);
+		qsearch->prev_match = NULL;
+	}
+}
+
+/* Build the text that the search key is matched against: the fields that
+   the quick search looks at, joined by newlines and folded to lower case
+   (the key can't contain a newline, so it never matches across fields). */
+static void quick_search_build_index(QuickSearch *qsearch)
+{
+	SummaryView *summaryview = qsearch->summaryview;
+	FolderItem *item = summaryview->folder_item;
+	gboolean is_sent;
+	GString *str;
+	gchar *p;
+	GSList *cur;
+
+	quick_search_clear_index(qsearch);
+
+	is_sent = FOLDER_ITEM_IS_SENT_FOLDER(item);
+	qsearch->index = g_array_new(FALSE, FALSE, sizeof(QSearchIndexEntry));
+	qsearch->index_chunk = g_string_chunk_new(16384);
+	qsearch->index_item = item;
+	str = g_string_sized_new(256);
+
+	for (cur = summaryview->all_mlist; cur != NULL; cur = cur->next) {
+		MsgInfo *msginfo = (MsgInfo *)cur->data;
+		QSearchIndexEntry entry;
+
+		g_string_truncate(str, 0);
+		if (msginfo->subject)
+			g_string_append(str, msginfo->subject);
+		g_string_append_c(str, '\n');
+		if (msginfo->from)
+			g_string_append(str, msginfo->from);
+		if (is_sent) {
+			g_string_append_c(str, '\n');
+			if (msginfo->to)
+				g_string_append(str, msginfo->to);
+			g_string_append_c(str, '\n');
+			if (msginfo->cc)
+				g_string_append(str, msginfo->cc);
+		}
+		for (p = str->str; *p != '\0'; p++)
+			*p = g_ascii_tolower(*p);
+
+		entry.msginfo = msginfo;
+		entry.text = g_string_chunk_insert(qsearch->index_chunk,
+						   str->str);
+		g_array_append_val(qsearch->index, entry);
+	}
+
+	g_string_free(str, TRUE);
+
+	debug_print("quick_search_build_index: %u messages indexed\n",
+		    qsearch->index->len);
+}
+
+/* Return the indices of the index entries which contain the key.  If the
+   key extends the previous one, only the previous matches can match. */
+static GArray *quick_search_match_key(QuickSearch *qsearch, const gchar *key)
+{
+	GArray *match;
+	QSearchIndexEntry *entries;
+	gchar *lkey;
+	guint i;
+
+	if (!qsearch->index ||
+	    qsearch->index_item != qsearch->summaryview->folder_item)
+		quick_search_build_index(qsearch);
+
+	entries = (QSearchIndexEntry *)qsearch->index->data;
+	lkey = g_ascii_strdown(key, -1);
+
+	if (qsearch->prev_match && qsearch->prev_key &&
+	    strstr(lkey, qsearch->prev_key) != NULL) {
+		GArray *prev = qsearch->prev_match;
+
+		debug_print("quick_search_match_key: refining %u matches\n",
+			    prev->len);
+		match = g_array_sized_new(FALSE, FALSE, sizeof(guint),
+					  prev->len);
+		for (i = 0; i < prev->len; i++) {
+			guint n = g_array_index(prev, guint, i);
+
+			if (strstr(entries[n].text, lkey) != NULL)
+				g_array_append_val(match, n);
+		}
+		g_array_free(prev, TRUE);
+	} else {
+		match = g_array_new(FALSE, FALSE, sizeof(guint));
+		for (i = 0; i < qsearch->index->len; i++) {
+			if (strstr(entries[i].text, lkey) != NULL)
+				g_array_append_val(match, i);
+		}
+		if (qsearch->prev_match)
+			g_array_free(qsearch->prev_match, TRUE);
+	}
+
+	g_free(qsearch->prev_key);
+	qsearch->prev_key = lkey;
+	qsearch->prev_match = match;
+
+	return match;
+}
+
 GSList *quick_search_filter(QuickSearch *qsearch, QSearchCondType type,
 			   const gchar *key)
 {
 	SummaryView *summaryview = qsearch->summaryview;
 	FilterCondType ftype;
 	FilterRule *status_rule = NULL;
-	FilterRule *rule = NULL;
 	FilterCond *cond;
 	FilterInfo fltinfo;
 	GSList *cond_list = NULL;
@@ -272,67 +402,52 @@ GSList *quick_search_filter(QuickSearch *qsearch, QSearchCondType type,
 		break;
 	}
 
-	cond_list = NULL;
-
-	if (key && *key != '\0') {
-		cond = filter_cond_new(FLT_COND_HEADER, FLT_CONTAIN, 0,
-				       "Subject", key);
-		cond_list = g_slist_append(cond_list, cond);
-		cond = filter_cond_new(FLT_COND_HEADER, FLT_CONTAIN, 0,
-				       "From", key);
-		cond_list = g_slist_append(cond_list, cond);
-		if (FOLDER_ITEM_IS_SENT_FOLDER(summaryview->folder_item)) {
-			cond = filter_cond_new(FLT_COND_TO_OR_CC, FLT_CONTAIN,
-					       0, NULL, key);
-			cond_list = g_slist_append(cond_list, cond);
-		}
-		rule = filter_rule_new("Quick search rule", FLT_OR, cond_list,
-				       NULL);
-	}
-
 	memset(&fltinfo, 0, sizeof(FilterInfo));
 	dmode = get_debug_mode();
 	set_debug_mode(FALSE);
 
-	for (cur = summaryview->all_mlist; cur != NULL; cur = cur->next) {
-		MsgInfo *msginfo = (MsgInfo *)cur->data;
-		GSList *hlist = NULL;
-
-		total++;
-
-		if (status_rule) {
-			if (type == QS_IN_ADDRESSBOOK)
-				hlist = procheader_get_header_list_from_msginfo
-					(msginfo);
-			if (!filter_match_rule(status_rule, msginfo, hlist,
-					       &fltinfo)) {
-				if (hlist)
-					procheader_header_list_destroy(hlist);
+	/* header conditions are matched against the summary cache
+	   of msginfo directly (hlist == NULL) */
+	if (key && *key != '\0') {
+		QSearchIndexEntry *entries;
+		GArray *match;
+		guint i;
+
+		match = quick_search_match_key(qsearch, key);
+		entries = (QSearchIndexEntry *)qsearch->index->data;
+		total = qsearch->index->len;
+
+		for (i = 0; i < match->len; i++) {
+			MsgInfo *msginfo =
+				entries[g_array_index(match, guint, i)].msginfo;
+
+			if (status_rule &&
+			    !filter_match_rule(status_rule, msginfo, NULL,
+					       &fltinfo))
 				continue;
-			}
+			flt_mlist = g_slist_prepend(flt_mlist, msginfo);
+			count++;
 		}
+	} else {
+		for (cur = summaryview->all_mlist; cur != NULL;
+		     cur = cur->next) {
+			MsgInfo *msginfo = (MsgInfo *)cur->data;
 
-		if (rule) {
-			if (!hlist)
-				hlist = procheader_get_header_list_from_msginfo
-					(msginfo);
-			if (filter_match_rule(rule, msginfo, hlist, &fltinfo)) {
-				flt_mlist = g_slist_prepend(flt_mlist, msginfo);
-				count++;
-			}
-		} else {
+			total++;
+
+			if (status_rule &&
+			    !filter_match_rule(status_rule, msginfo, NULL,
+					       &fltinfo))
+				continue;
 			flt_mlist = g_slist_prepend(flt_mlist, msginfo);
 			count++;
 		}
-
-		if (hlist)
-			procheader_header_list_destroy(hlist);
 	}
 	flt_mlist = g_slist_reverse(flt_mlist);
 
 	set_debug_mode(dmode);
 
-	if (status_rule || rule) {
+	if (status_rule || (key && *key != '\0')) {
 		if (count > 0)
 			g_snprintf(status_text, sizeof(status_text),
 				   _("%1$d in %2$d matched"), count, total);
@@ -344,7 +459,6 @@ GSList *quick_search_filter(QuickSearch *qsearch, QSearchCondType type,
 	} else
 		gtk_label_set_text(GTK_LABEL(qsearch->status_label), "");
 
-	filter_rule_free(rule);
 	filter_rule_free(status_rule);
 
 	return flt_mlist;
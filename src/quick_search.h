@@ -52,11 +52,21 @@ struct _QuickSearch
 	SummaryView *summaryview;
 
 	gboolean entry_entered;
+
+	/* search index of summaryview->all_mlist */
+	GArray *index;
+	GStringChunk *index_chunk;
+	FolderItem *index_item;
+
+	/* key matches of the last search, refined by the next one */
+	gchar *prev_key;
+	GArray *prev_match;
 };
 
 QuickSearch *quick_search_create(SummaryView		*summaryview);
 
 void quick_search_clear_entry	(QuickSearch		*qsearch);
+void quick_search_clear_index	(QuickSearch		*qsearch);
 
 GSList *quick_search_filter	(QuickSearch		*qsearch,
 				 QSearchCondType	 type,
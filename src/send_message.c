@@ -65,21 +65,69 @@
 #endif
 
 typedef struct _SendProgressDialog	SendProgressDialog;
+typedef struct _SendQueueEntry		SendQueueEntry;
+typedef struct _SendQueueGroup		SendQueueGroup;
+typedef struct _SendQueueSession	SendQueueSession;
 
 struct _SendProgressDialog
 {
 	ProgressDialog *dialog;
 	Session *session;
+	GSList *queue_list;	/* list of SendQueueSession */
+	gint n_rows;
 	gboolean show_dialog;
 	gboolean cancelled;
 };
 
+struct _SendQueueEntry
+{
+	MsgInfo *msginfo;
+	gchar *file;
+	QueueInfo *qinfo;	/* qinfo->fp is closed while waiting */
+	glong fpos;
+	gboolean sent;
+};
+
+/* queued messages sent through the same account */
+struct _SendQueueGroup
+{
+	PrefsAccount *ac;
+	GSList *pending;	/* list of SendQueueEntry */
+	gint n_sessions;
+	gboolean aborted;
+};
+
+struct _SendQueueSession
+{
+	Session *session;
+	SendQueueGroup *group;
+	SendQueueEntry *entry;	/* message being sent */
+	SendProgressDialog *dialog;
+	gint row;
+	gint n_sent;
+	gboolean ready;		/* reached MAIL FROM */
+};
+
+#define SEND_DIALOG_ROW(session) \
+	((session)->data ? ((SendQueueSession *)(session)->data)->row : 0)
+
 static gint send_message_local		(const gchar		*command,
 					 FILE			*fp);
 static gint send_message_smtp		(PrefsAccount		*ac_prefs,
 					 GSList			*to_list,
 					 FILE			*fp);
 
+static Session *send_smtp_session_new	(PrefsAccount		*ac_prefs);
+static gint send_smtp_session_set_message
+					(Session		*session,
+					 GSList			*to_list,
+					 FILE			*fp);
+static gint send_smtp_session_connect	(Session		*session,
+					 PrefsAccount		*ac_prefs,
+					 SendProgressDialog	*dialog);
+static gint send_smtp_session_get_result(Session		*session,
+					 PrefsAccount		*ac_prefs);
+
 static gint send_recv_message		(Session		*session,
 					 const gchar		*msg,
 					 gpointer		 data);
@@ -360,11 +408,269 @@ gint send_message_queue(QueueInfo *qinfo)
 	return val;
 }
 
+static gboolean send_queue_can_batch(QueueInfo *qinfo)
+{
+	PrefsAccount *ac = qinfo->ac;
+
+	if (prefs_common.use_extsend && prefs_common.extsend_cmd)
+		return FALSE;
+	if (!ac || ac->protocol == A_NNTP || !qinfo->to_list)
+		return FALSE;
+	if (!ac->address || !ac->smtp_server)
+		return FALSE;
+
+	return TRUE;
+}
+
+static SendQueueGroup *send_queue_group_find(GSList *groups,
+					     PrefsAccount *ac)
+{
+	GSList *cur;
+
+	for (cur = groups; cur != NULL; cur = cur->next) {
+		SendQueueGroup *group = (SendQueueGroup *)cur->data;
+		if (group->ac == ac)
+			return group;
+	}
+
+	return NULL;
+}
+
+static gint send_queue_entry_open(SendQueueEntry *entry)
+{
+	if (entry->qinfo->fp)
+		return 0;
+
+	if ((entry->qinfo->fp = g_fopen(entry->file, "rb")) == NULL) {
+		FILE_OP_ERROR(entry->file, "fopen");
+		return -1;
+	}
+	if (fseek(entry->qinfo->fp, entry->fpos, SEEK_SET) < 0) {
+		FILE_OP_ERROR(entry->file, "fseek");
+		fclose(entry->qinfo->fp);
+		entry->qinfo->fp = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+static void send_queue_entry_close(SendQueueEntry *entry)
+{
+	if (entry->qinfo->fp) {
+		fclose(entry->qinfo->fp);
+		entry->qinfo->fp = NULL;
+	}
+}
+
+static gboolean send_queue_session_set_next(SendQueueSession *qsession)
+{
+	SendQueueGroup *group = qsession->group;
+	SendQueueEntry *entry;
+	gint ret = -1;
+
+	qsession->entry = NULL;
+
+	while (group->pending != NULL) {
+		entry = (SendQueueEntry *)group->pending->data;
+		group->pending = g_slist_remove(group->pending, entry);
+
+		if (send_queue_entry_open(entry) == 0) {
+			ret = send_smtp_session_set_message
+				(qsession->session, entry->qinfo->to_list,
+				 entry->qinfo->fp);
+			send_queue_entry_close(entry);
+		}
+
+		if (ret == 0) {
+			qsession->entry = entry;
+			return TRUE;
+		}
+
+		g_warning("Sending queued message %d failed.\n",
+			  entry->msginfo->msgnum);
+	}
+
+	return FALSE;
+}
+
+static gboolean send_queue_next_message(SMTPSession *smtp_session,
+					gpointer data)
+{
+	SendQueueSession *qsession = (SendQueueSession *)data;
+
+	if (qsession->entry) {
+		qsession->entry->sent = TRUE;
+		qsession->n_sent++;
+		debug_print("send_queue_next_message: message %d sent\n",
+			    qsession->entry->msginfo->msgnum);
+	}
+
+	if (qsession->dialog->cancelled)
+		return FALSE;
+
+	return send_queue_session_set_next(qsession);
+}
+
+static gint send_queue_session_start(SendQueueGroup *group,
+				     SendProgressDialog *dialog)
+{
+	SendQueueSession *qsession;
+	Session *session;
+
+	qsession = g_new0(SendQueueSession, 1);
+	qsession->group = group;
+	qsession->dialog = dialog;
+
+	session = send_smtp_session_new(group->ac);
+	session->data = qsession;
+	qsession->session = session;
+
+	if (!send_queue_session_set_next(qsession)) {
+		session_destroy(session);
+		g_free(qsession);
+		return 0;
+	}
+
+	SMTP_SESSION(session)->next_msg_func = send_queue_next_message;
+	SMTP_SESSION(session)->next_msg_data = qsession;
+
+	qsession->row = dialog->n_rows++;
+	progress_dialog_append(dialog->dialog, NULL, group->ac->smtp_server,
+			       _("Connecting"), "", NULL);
+
+	if (send_smtp_session_connect(session, group->ac, dialog) < 0) {
+		if (dialog->show_dialog)
+			manage_window_focus_in(dialog->dialog->window, NULL, NULL);
+		send_put_error(session);
+		if (dialog->show_dialog)
+			manage_window_focus_out(dialog->dialog->window, NULL, NULL);
+		session_destroy(session);
+		g_free(qsession);
+		return -1;
+	}
+
+	group->n_sessions++;
+	dialog->queue_list = g_slist_append(dialog->queue_list, qsession);
+
+	return 0;
+}
+
+static void send_queue_group_start_sessions(SendQueueGroup *group,
+					    SendProgressDialog *dialog)
+{
+	gint max_conn;
+
+	max_conn = MAX(prefs_common.smtp_max_connections, 1);
+
+	while (!group->aborted && !dialog->cancelled && group->pending &&
+	       group->n_sessions < max_conn) {
+		if (send_queue_session_start(group, dialog) < 0)
+			group->aborted = TRUE;
+	}
+}
+
+static void send_queue_session_finish(SendQueueSession *qsession)
+{
+	SendQueueGroup *group = qsession->group;
+	SendProgressDialog *dialog = qsession->dialog;
+	Session *session = qsession->session;
+	gint ret;
+
+	ret = send_smtp_session_get_result(session, group->ac);
+	if (dialog->cancelled)
+		ret = -1;
+
+	if (ret < 0 && !dialog->cancelled) {
+		/* errors before the first MAIL FROM are not specific to
+		   the message: give up the rest of the group */
+		if (qsession->entry && qsession->n_sent == 0 &&
+		    !qsession->ready)
+			group->aborted = TRUE;
+		if (qsession->entry)
+			g_warning("Sending queued message %d failed.\n",
+				  qsession->entry->msginfo->msgnum);
+
+		if (dialog->show_dialog)
+			manage_window_focus_in(dialog->dialog->window, NULL, NULL);
+		send_put_error(session);
+		if (dialog->show_dialog)
+			manage_window_focus_out(dialog->dialog->window, NULL, NULL);
+	}
+
+	progress_dialog_set_row_status(dialog->dialog, qsession->row,
+				       ret < 0 ? _("Error") : _("Done"));
+
+	dialog->queue_list = g_slist_remove(dialog->queue_list, qsession);
+	group->n_sessions--;
+	session_destroy(session);
+	g_free(qsession);
+
+	/* reconnect for the remaining messages */
+	send_queue_group_start_sessions(group, dialog);
+}
+
+static void send_queue_send_groups(GSList *groups)
+{
+	SendProgressDialog *dialog;
+	GSList *cur;
+
+	dialog = send_progress_dialog_create();
+
+	inc_lock();
+
+	for (cur = groups; cur != NULL; cur = cur->next) {
+		SendQueueGroup *group = (SendQueueGroup *)cur->data;
+
+		if (group->ac->pop_before_smtp &&
+		    group->ac->protocol == A_POP3) {
+			if (inc_pop_before_smtp(group->ac) < 0) {
+				group->aborted = TRUE;
+				continue;
+			}
+		}
+
+		send_queue_group_start_sessions(group, dialog);
+	}
+
+	debug_print("send_queue_send_groups(): begin event loop\n");
+
+	while (dialog->queue_list && dialog->cancelled == FALSE) {
+		GSList *next;
+
+		gtk_main_iteration();
+
+		for (cur = dialog->queue_list; cur != NULL; cur = next) {
+			SendQueueSession *qsession =
+				(SendQueueSession *)cur->data;
+
+			next = cur->next;
+			if (!session_is_connected(qsession->session)) {
+				send_queue_session_finish(qsession);
+				next = dialog->queue_list;
+			}
+		}
+	}
+	log_window_flush();
+
+	/* cancelled */
+	while (dialog->queue_list) {
+		SendQueueSession *qsession =
+			(SendQueueSession *)dialog->queue_list->data;
+		send_queue_session_finish(qsession);
+	}
+
+	send_progress_dialog_destroy(dialog);
+	inc_unlock();
+}
+
 gint send_message_queue_all(FolderItem *queue, gboolean save_msgs,
 			    gboolean filter_msgs)
 {
 	gint ret = 0;
 	GSList *mlist = NULL;
+	GSList *entries = NULL;
+	GSList *groups = NULL;
 	GSList *cur;
 
 	if (!queue)
@@ -378,35 +684,89 @@ gint send_message_queue_all(FolderItem *queue, gboolean save_msgs,
 		gchar *file;
 		MsgInfo *msginfo = (MsgInfo *)cur->data;
 		QueueInfo *qinfo;
+		SendQueueEntry *entry;
+		SendQueueGroup *group;
 
 		file = procmsg_get_message_file(msginfo);
 		if (!file)
 			continue;
 
 		qinfo = send_get_queue_info(file);
-		if (!qinfo || send_message_queue(qinfo) < 0) {
+		if (!qinfo) {
 			g_warning("Sending queued message %d failed.\n",
 				  msginfo->msgnum);
-			send_queue_info_free(qinfo);
 			g_free(file);
 			continue;
 		}
 
-		if (qinfo->reply_target)
-			send_message_set_reply_flag(qinfo->reply_target,
-						    msginfo->inreplyto);
-		else if (qinfo->forward_targets)
-			send_message_set_forward_flags(qinfo->forward_targets);
+		entry = g_new0(SendQueueEntry, 1);
+		entry->msginfo = msginfo;
+		entry->file = file;
+		entry->qinfo = qinfo;
+		entry->fpos = ftell(qinfo->fp);
+		entries = g_slist_prepend(entries, entry);
+
+		if (!send_queue_can_batch(qinfo)) {
+			if (send_message_queue(qinfo) < 0)
+				g_warning("Sending queued message %d failed.\n",
+					  msginfo->msgnum);
+			else
+				entry->sent = TRUE;
+			send_queue_entry_close(entry);
+			continue;
+		}
 
-		if (save_msgs)
-			send_save_queued_message(qinfo, filter_msgs);
+		/* don't keep hundreds of files open while waiting */
+		send_queue_entry_close(entry);
+
+		/* group messages per account to reuse the connection */
+		group = send_queue_group_find(groups, qinfo->ac);
+		if (!group) {
+			group = g_new0(SendQueueGroup, 1);
+			group->ac = qinfo->ac;
+			groups = g_slist_append(groups, group);
+		}
+		group->pending = g_slist_append(group->pending, entry);
+	}
+
+	entries = g_slist_reverse(entries);
+
+	if (groups)
+		send_queue_send_groups(groups);
+
+	for (cur = entries; cur != NULL; cur = cur->next) {
+		SendQueueEntry *entry = (SendQueueEntry *)cur->data;
+		MsgInfo *msginfo = entry->msginfo;
+		QueueInfo *qinfo = entry->qinfo;
+
+		if (entry->sent) {
+			if (qinfo->reply_target)
+				send_message_set_reply_flag
+					(qinfo->reply_target,
+					 msginfo->inreplyto);
+			else if (qinfo->forward_targets)
+				send_message_set_forward_flags
+					(qinfo->forward_targets);
+
+			if (save_msgs && send_queue_entry_open(entry) == 0)
+				send_save_queued_message(qinfo, filter_msgs);
+
+			folder_item_remove_msg(queue, msginfo);
+			ret++;
+		}
 
 		send_queue_info_free(qinfo);
-		g_free(file);
+		g_free(entry->file);
+		g_free(entry);
+	}
 
-		folder_item_remove_msg(queue, msginfo);
-		ret++;
+	for (cur = groups; cur != NULL; cur = cur->next) {
+		SendQueueGroup *group = (SendQueueGroup *)cur->data;
+		g_slist_free(group->pending);
+		g_free(group);
 	}
+	g_slist_free(groups);
+	g_slist_free(entries);
 
 	procmsg_msg_list_free(mlist);
 
@@ -618,22 +978,10 @@ static gint send_message_local(const gchar *command, FILE *fp)
 	return 0;
 }
 
-static gint send_message_smtp(PrefsAccount *ac_prefs, GSList *to_list, FILE *fp)
+static Session *send_smtp_session_new(PrefsAccount *ac_prefs)
 {
 	Session *session;
 	SMTPSession *smtp_session;
-	SocksInfo *socks_info = NULL;
-	FILE *out_fp;
-	gushort port;
-	SendProgressDialog *dialog;
-	gchar buf[BUFFSIZE];
-	gint ret = 0;
-
-	g_return_val_if_fail(ac_prefs != NULL, -1);
-	g_return_val_if_fail(ac_prefs->address != NULL, -1);
-	g_return_val_if_fail(ac_prefs->smtp_server != NULL, -1);
-	g_return_val_if_fail(to_list != NULL, -1);
-	g_return_val_if_fail(fp != NULL, -1);
 
 	session = smtp_session_new();
 	smtp_session = SMTP_SESSION(session);
@@ -690,44 +1038,65 @@ static gint send_message_smtp(PrefsAccount *ac_prefs, GSList *to_list, FILE *fp)
 	}
 
 	smtp_session->from = g_strdup(ac_prefs->address);
-	smtp_session->to_list = to_list;
-	smtp_session->cur_to = to_list;
 
-	out_fp = get_outgoing_rfc2822_file(fp);
-	if (!out_fp) {
-		session_destroy(session);
+#if USE_SSL
+	session->ssl_type = ac_prefs->ssl_smtp;
+	if (ac_prefs->ssl_smtp != SSL_NONE)
+		session->nonblocking = ac_prefs->use_nonblocking_ssl;
+#endif
+
+	return session;
+}
+
+/* set the message to be sent next by the SMTP session */
+static gint send_smtp_session_set_message(Session *session, GSList *to_list,
+					  FILE *fp)
+{
+	SMTPSession *smtp_session = SMTP_SESSION(session);
+	FILE *out_fp;
+	gint len;
+	gboolean dot_stuff;
+
+	/* the ESMTP capabilities are known only when the session is reused
+	   for the next message. Otherwise dot-stuff the data while converting
+	   it, so that it is not copied once more for DATA (BDAT is used
+	   from the next message on) */
+	dot_stuff = (smtp_session->avail_esmtp_flags & ESMTP_CHUNKING) == 0;
+	out_fp = get_outgoing_rfc2822_file_full(fp, dot_stuff);
+	if (!out_fp)
 		return -1;
-	}
-	smtp_session->send_data_fp = out_fp;
-	smtp_session->send_data_len = get_left_file_size(out_fp);
-	if (smtp_session->send_data_len < 0) {
-		session_destroy(session);
+	len = get_left_file_size(out_fp);
+	if (len < 0) {
+		fclose(out_fp);
 		return -1;
 	}
 
+	if (smtp_session->send_data_fp)
+		fclose(smtp_session->send_data_fp);
+	smtp_session->send_data_fp = out_fp;
+	smtp_session->send_data_len = len;
+	smtp_session->send_data_dot_stuffed = dot_stuff;
+
+	smtp_session->to_list = to_list;
+	smtp_session->cur_to = to_list;
+
+	return 0;
+}
+
+static gint send_smtp_session_connect(Session *session, PrefsAccount *ac_prefs,
+				      SendProgressDialog *dialog)
+{
+	SocksInfo *socks_info = NULL;
+	gushort port;
+	gchar buf[BUFFSIZE];
+
 #if USE_SSL
 	port = ac_prefs->set_smtpport ? ac_prefs->smtpport :
 		ac_prefs->ssl_smtp == SSL_TUNNEL ? SSMTP_PORT : SMTP_PORT;
-	session->ssl_type = ac_prefs->ssl_smtp;
-	if (ac_prefs->ssl_smtp != SSL_NONE)
-		session->nonblocking = ac_prefs->use_nonblocking_ssl;
 #else
 	port = ac_prefs->set_smtpport ? ac_prefs->smtpport : SMTP_PORT;
 #endif
 
-	if (ac_prefs->pop_before_smtp && ac_prefs->protocol == A_POP3) {
-		if (inc_pop_before_smtp(ac_prefs) < 0) {
-			session_destroy(session);
-			return -1;
-		}
-	}
-
-	dialog = send_progress_dialog_create();
-	dialog->session = session;
-
-	progress_dialog_append(dialog->dialog, NULL, ac_prefs->smtp_server,
-			       _("Connecting"), "", NULL);
-
 	g_snprintf(buf, sizeof(buf), _("Connecting to SMTP server: %s ..."),
 		   ac_prefs->smtp_server);
 	progress_dialog_set_label(dialog->dialog, buf);
@@ -750,26 +1119,14 @@ static gint send_message_smtp(PrefsAccount *ac_prefs, GSList *to_list, FILE *fp)
 						? ac_prefs->proxy_pass : NULL);
 	}
 
-	inc_lock();
-
-	if (session_connect_full(session, ac_prefs->smtp_server, port,
-				 socks_info) < 0) {
-		if (dialog->show_dialog)
-			manage_window_focus_in(dialog->dialog->window, NULL, NULL);
-		send_put_error(session);
-		if (dialog->show_dialog)
-			manage_window_focus_out(dialog->dialog->window, NULL, NULL);
-		session_destroy(session);
-		send_progress_dialog_destroy(dialog);
-		inc_unlock();
-		return -1;
-	}
-
-	debug_print("send_message_smtp(): begin event loop\n");
+	return session_connect_full(session, ac_prefs->smtp_server, port,
+				    socks_info);
+}
 
-	while (session_is_connected(session) && dialog->cancelled == FALSE)
-		gtk_main_iteration();
-	log_window_flush();
+static gint send_smtp_session_get_result(Session *session,
+					 PrefsAccount *ac_prefs)
+{
+	gint ret = 0;
 
 	if (SMTP_SESSION(session)->error_val == SM_AUTHFAIL) {
 		if (ac_prefs->smtp_userid && ac_prefs->tmp_smtp_pass) {
@@ -796,7 +1153,64 @@ static gint send_message_smtp(PrefsAccount *ac_prefs, GSList *to_list, FILE *fp)
 		   SMTP_SESSION(session)->state == SMTP_ERROR ||
 		   SMTP_SESSION(session)->error_val != SM_OK)
 		ret = -1;
-	else if (dialog->cancelled == TRUE)
+
+	return ret;
+}
+
+static gint send_message_smtp(PrefsAccount *ac_prefs, GSList *to_list, FILE *fp)
+{
+	Session *session;
+	SendProgressDialog *dialog;
+	gint ret = 0;
+
+	g_return_val_if_fail(ac_prefs != NULL, -1);
+	g_return_val_if_fail(ac_prefs->address != NULL, -1);
+	g_return_val_if_fail(ac_prefs->smtp_server != NULL, -1);
+	g_return_val_if_fail(to_list != NULL, -1);
+	g_return_val_if_fail(fp != NULL, -1);
+
+	session = send_smtp_session_new(ac_prefs);
+
+	if (send_smtp_session_set_message(session, to_list, fp) < 0) {
+		session_destroy(session);
+		return -1;
+	}
+
+	if (ac_prefs->pop_before_smtp && ac_prefs->protocol == A_POP3) {
+		if (inc_pop_before_smtp(ac_prefs) < 0) {
+			session_destroy(session);
+			return -1;
+		}
+	}
+
+	dialog = send_progress_dialog_create();
+	dialog->session = session;
+
+	progress_dialog_append(dialog->dialog, NULL, ac_prefs->smtp_server,
+			       _("Connecting"), "", NULL);
+
+	inc_lock();
+
+	if (send_smtp_session_connect(session, ac_prefs, dialog) < 0) {
+		if (dialog->show_dialog)
+			manage_window_focus_in(dialog->dialog->window, NULL, NULL);
+		send_put_error(session);
+		if (dialog->show_dialog)
+			manage_window_focus_out(dialog->dialog->window, NULL, NULL);
+		session_destroy(session);
+		send_progress_dialog_destroy(dialog);
+		inc_unlock();
+		return -1;
+	}
+
+	debug_print("send_message_smtp(): begin event loop\n");
+
+	while (session_is_connected(session) && dialog->cancelled == FALSE)
+		gtk_main_iteration();
+	log_window_flush();
+
+	ret = send_smtp_session_get_result(session, ac_prefs);
+	if (dialog->cancelled == TRUE)
 		ret = -1;
 
 	if (ret == -1) {
@@ -872,8 +1286,12 @@ static gint send_recv_message(Session *session, const gchar *msg, gpointer data)
 		return 0;
 	}
 
+	if (smtp_session->state == SMTP_FROM && session->data)
+		((SendQueueSession *)session->data)->ready = TRUE;
+
 	progress_dialog_set_label(dialog->dialog, buf);
-	progress_dialog_set_row_status(dialog->dialog, 0, state_str);
+	progress_dialog_set_row_status(dialog->dialog, SEND_DIALOG_ROW(session),
+				       state_str);
 
 	gdk_threads_leave();
 
@@ -889,6 +1307,7 @@ static gint send_send_data_progressive(Session *session, guint cur_len,
 	g_return_val_if_fail(dialog != NULL, -1);
 
 	if (SMTP_SESSION(session)->state != SMTP_SEND_DATA &&
+	    SMTP_SESSION(session)->state != SMTP_BDAT &&
 	    SMTP_SESSION(session)->state != SMTP_EOM)
 		return 0;
 
@@ -901,7 +1320,8 @@ static gint send_send_data_progressive(Session *session, guint cur_len,
 		(dialog->dialog, (gfloat)cur_len / (gfloat)total_len);
 	g_snprintf(buf, sizeof(buf), _("%d / %d bytes"),
 		   cur_len, total_len);
-	progress_dialog_set_row_progress(dialog->dialog, 0, buf);
+	progress_dialog_set_row_progress(dialog->dialog,
+					 SEND_DIALOG_ROW(session), buf);
 #ifdef G_OS_WIN32
 	GTK_EVENTS_FLUSH();
 #endif
@@ -963,8 +1383,15 @@ static void send_cancel_button_cb(GtkWidget *widget, gpointer data)
 {
 	SendProgressDialog *dialog = (SendProgressDialog *)data;
 
+	GSList *cur;
+
 	dialog->cancelled = TRUE;
-	session_disconnect(dialog->session);
+	if (dialog->session)
+		session_disconnect(dialog->session);
+	for (cur = dialog->queue_list; cur != NULL; cur = cur->next) {
+		SendQueueSession *qsession = (SendQueueSession *)cur->data;
+		session_disconnect(qsession->session);
+	}
 }
 
 static void send_put_error(Session *session)
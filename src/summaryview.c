@@ -64,6 +64,7 @@
 #include "foldersel.h"
 #include "procmsg.h"
 #include "procheader.h"
+#include "procmime.h"
 #include "sourcewindow.h"
 #include "prefs_common.h"
 #include "prefs_summary_column.h"
@@ -116,6 +117,10 @@
 	if (sort_key == key)					\
 		summary_sort(summaryview, sort_key, sort_type);
 
+#define SORT_KEY_IS_STRING(key)						\
+	((key) == SORT_BY_SUBJECT || (key) == SORT_BY_FROM ||		\
+	 (key) == SORT_BY_TO)
+
 #define SUMMARY_DISPLAY_TOTAL_NUM(item) \
 	(summaryview->on_filter ? summaryview->flt_msg_total : item->total)
 
@@ -152,6 +157,7 @@ static void summary_restore_tmp_marks	(SummaryView	*summaryview,
 					 GSList		*save_mark_mlist);
 
 static void summary_update_msg_list	(SummaryView		*summaryview);
+static gboolean summary_update_by_diff	(SummaryView		*summaryview);
 
 static void summary_msgid_table_create	(SummaryView		*summaryview);
 static void summary_msgid_table_destroy	(SummaryView		*summaryview);
@@ -203,6 +209,20 @@ static void summary_update_status	(SummaryView		*summaryview);
 
 /* display functions */
 static void summary_status_show		(SummaryView		*summaryview);
+static const gchar *summary_get_sort_key
+					(SummaryView		*summaryview,
+					 MsgInfo		*msginfo,
+					 FolderSortKey		 sort_key);
+static void summary_set_sort_keys	(SummaryView		*summaryview,
+					 FolderSortKey		 sort_key);
+static GSList *summary_sort_mlist	(SummaryView		*summaryview,
+					 GSList			*mlist);
+
+static void summary_text_cell_data_func	(GtkTreeViewColumn	*column,
+					 GtkCellRenderer	*renderer,
+					 GtkTreeModel		*model,
+					 GtkTreeIter		*iter,
+					 gpointer		 data);
 static void summary_set_row		(SummaryView		*summaryview,
 					 GtkTreeIter		*iter,
 					 MsgInfo		*msginfo);
@@ -224,6 +244,8 @@ static void summary_activate_selected	(SummaryView		*summaryview);
 /* message handling */
 static void summary_mark_row		(SummaryView		*summaryview,
 					 GtkTreeIter		*iter);
+static void summary_mark_rows_as_read	(SummaryView		*summaryview,
+					 GArray			*iters);
 static void summary_mark_row_as_read	(SummaryView		*summaryview,
 					 GtkTreeIter		*iter);
 static void summary_mark_row_as_unread	(SummaryView		*summaryview,
@@ -261,6 +283,8 @@ static GtkWidget *summary_tree_view_create
 					(SummaryView	*summaryview);
 
 /* callback functions */
+static void summary_destroy		(GtkWidget		*widget,
+					 SummaryView		*summaryview);
 static gboolean summary_toggle_pressed	(GtkWidget		*eventbox,
 					 GdkEventButton		*event,
 					 SummaryView		*summaryview);
@@ -565,6 +589,7 @@ SummaryView *summary_create(void)
 	summaryview->treeview = treeview;
 	summaryview->store = store;
 	summaryview->selection = selection;
+	summaryview->sort_key_chunk = g_string_chunk_new(4096);
 	summaryview->hseparator = hseparator;
 	summaryview->hbox = hbox;
 	summaryview->statlabel_folder = statlabel_folder;
@@ -591,6 +616,9 @@ SummaryView *summary_create(void)
 			    summaryview->nojunk_menuitem);
 	summaryview->junk_separator = GTK_WIDGET(child->next->data);
 
+	g_signal_connect(G_OBJECT(vbox), "destroy",
+			 G_CALLBACK(summary_destroy), summaryview);
+
 	gtk_widget_show_all(vbox);
 
 	return summaryview;
@@ -675,6 +703,120 @@ static void get_msg_list_func(Folder *folder, FolderItem *item, gpointer data)
 	}
 }
 
+#if USE_THREADS
+typedef struct _SummaryLoadData
+{
+	SummaryView *summaryview;
+	FolderItem *item;
+	gboolean use_cache;
+	GSList *mlist;
+	volatile gint count;
+	volatile gint flag;
+} SummaryLoadData;
+
+/* called in the loading thread */
+static void summary_load_ui_func(Folder *folder, FolderItem *item,
+				 gpointer data)
+{
+	SummaryLoadData *load_data = (SummaryLoadData *)folder->data;
+
+	g_atomic_int_set(&load_data->count, GPOINTER_TO_INT(data));
+}
+
+static gboolean summary_load_progress_func(gpointer data)
+{
+	SummaryLoadData *load_data = (SummaryLoadData *)data;
+	gint count;
+
+	count = g_atomic_int_get(&load_data->count);
+	if (count > 0) {
+		gchar buf[256];
+
+		g_snprintf(buf, sizeof(buf), _("Scanning folder (%s) (%d)..."),
+			   load_data->item->path, count);
+		STATUSBAR_POP(load_data->summaryview->mainwin);
+		STATUSBAR_PUSH(load_data->summaryview->mainwin, buf);
+	}
+
+	return TRUE;
+}
+
+static gpointer summary_load_func(gpointer data)
+{
+	SummaryLoadData *load_data = (SummaryLoadData *)data;
+
+	load_data->mlist = folder_item_get_msg_list(load_data->item,
+						    load_data->use_cache);
+
+	g_atomic_int_set(&load_data->flag, 1);
+	g_main_context_wakeup(NULL);
+
+	return NULL;
+}
+#endif /* USE_THREADS */
+
+/* Reads the message list of the folder. The local folders are read in
+   another thread so that the window keeps being redrawn and the progress
+   is shown while scanning large folders. */
+static GSList *summary_get_folder_msg_list(SummaryView *summaryview,
+					   FolderItem *item,
+					   gboolean use_cache)
+{
+	GSList *mlist;
+	gpointer save_data;
+
+	save_data = item->folder->data;
+
+#if USE_THREADS
+	if (FOLDER_TYPE(item->folder) == F_MH) {
+		SummaryLoadData load_data;
+		GThread *thread;
+		guint timer_tag;
+
+		load_data.summaryview = summaryview;
+		load_data.item = item;
+		load_data.use_cache = use_cache;
+		load_data.mlist = NULL;
+		load_data.count = 0;
+		load_data.flag = 0;
+
+		item->folder->data = &load_data;
+		folder_set_ui_func(item->folder, summary_load_ui_func, NULL);
+		timer_tag = g_timeout_add(100, summary_load_progress_func,
+					  &load_data);
+
+		thread = g_thread_create(summary_load_func, &load_data, TRUE,
+					 NULL);
+		if (thread) {
+			debug_print("summary_get_folder_msg_list: "
+				    "thread started\n");
+			while (g_atomic_int_get(&load_data.flag) == 0)
+				gtk_main_iteration();
+			g_thread_join(thread);
+			debug_print("summary_get_folder_msg_list: "
+				    "thread exited\n");
+		} else
+			summary_load_func(&load_data);
+
+		g_source_remove(timer_tag);
+		folder_set_ui_func(item->folder, NULL, NULL);
+		item->folder->data = save_data;
+
+		return load_data.mlist;
+	}
+#endif /* USE_THREADS */
+
+	item->folder->data = summaryview;
+	folder_set_ui_func(item->folder, get_msg_list_func, NULL);
+
+	mlist = folder_item_get_msg_list(item, use_cache);
+
+	folder_set_ui_func(item->folder, NULL, NULL);
+	item->folder->data = save_data;
+
+	return mlist;
+}
+
 gboolean summary_show(SummaryView *summaryview, FolderItem *item,
 		      gboolean update_cache)
 {
@@ -690,7 +832,6 @@ gboolean summary_show(SummaryView *summaryview, FolderItem *item,
 	gboolean do_qsearch = FALSE;
 	gboolean set_column_order_required = FALSE;
 	const gchar *key = NULL;
-	gpointer save_data;
 	GSList *save_mark_mlist = NULL;
 
 	if (summary_is_locked(summaryview)) return FALSE;
@@ -716,6 +857,12 @@ gboolean summary_show(SummaryView *summaryview, FolderItem *item,
 		displayed_msgnum = 0;
 	}
 
+	if (is_refresh && summary_update_by_diff(summaryview)) {
+		summary_unlock(summaryview);
+		inc_unlock();
+		return TRUE;
+	}
+
 	/* process the marks if any */
 	if (summaryview->mainwin->lock_count == 0 && !is_refresh &&
 	    (summaryview->moved > 0 || summaryview->copied > 0)) {
@@ -793,19 +940,13 @@ gboolean summary_show(SummaryView *summaryview, FolderItem *item,
 
 	main_window_cursor_wait(summaryview->mainwin);
 
-	save_data = item->folder->data;
-	item->folder->data = summaryview;
-	folder_set_ui_func(item->folder, get_msg_list_func, NULL);
-
-	mlist = folder_item_get_msg_list(item, !update_cache);
-
-	folder_set_ui_func(item->folder, NULL, NULL);
-	item->folder->data = save_data;
+	mlist = summary_get_folder_msg_list(summaryview, item, !update_cache);
 
 	statusbar_pop_all();
 	STATUSBAR_POP(summaryview->mainwin);
 
 	summaryview->all_mlist = mlist;
+	quick_search_clear_index(summaryview->qsearch);
 
 	/* restore temporary move/copy marks */
 	if (save_mark_mlist) {
@@ -1050,6 +1191,7 @@ static void summary_clear_list_full(SummaryView *summaryview,
 
 	procmsg_msg_list_free(summaryview->all_mlist);
 	summaryview->all_mlist = NULL;
+	quick_search_clear_index(summaryview->qsearch);
 
 	gtkut_tree_view_fast_clear(treeview, summaryview->store);
 
@@ -1118,6 +1260,7 @@ void summary_show_queued_msgs(SummaryView *summaryview)
 	}
 
 	summaryview->all_mlist = g_slist_concat(summaryview->all_mlist, qlist);
+	quick_search_clear_index(summaryview->qsearch);
 
 	item->cache_dirty = TRUE;
 	summary_selection_list_free(summaryview);
@@ -1127,6 +1270,117 @@ void summary_show_queued_msgs(SummaryView *summaryview)
 	debug_print("summary_show_queued_msgs: done.\n");
 }
 
+/* Updates the rows in place with the difference between the displayed
+   messages and the current message list of the folder. Returns FALSE if
+   the summary must be rebuilt instead. */
+static gboolean summary_update_by_diff(SummaryView *summaryview)
+{
+	FolderItem *item = summaryview->folder_item;
+	GtkTreeModel *model = GTK_TREE_MODEL(summaryview->store);
+	GtkTreeStore *store = summaryview->store;
+	GSList *mlist, *added, *removed, *changed, *cur;
+	MsgInfo *msginfo;
+	GtkTreeIter iter;
+	gboolean valid;
+	gchar *buf = NULL;
+
+	if (!item || !item->path || !item->parent || item->no_select ||
+	    item->stype == F_VIRTUAL || summaryview->on_filter ||
+	    !summaryview->all_mlist)
+		return FALSE;
+	if (FOLDER_TYPE(item->folder) == F_MH &&
+	    ((buf = folder_item_get_path(item)) == NULL ||
+	     change_dir(buf) < 0)) {
+		g_free(buf);
+		return FALSE;
+	}
+	g_free(buf);
+
+	summary_write_cache(summaryview);
+
+	mlist = summary_get_folder_msg_list(summaryview, item, TRUE);
+
+	statusbar_pop_all();
+	STATUSBAR_POP(summaryview->mainwin);
+
+	procmsg_update_msg_list(summaryview->all_mlist, mlist,
+				&added, &removed, &changed);
+
+	debug_print("summary_update_by_diff: %d added, %d removed, "
+		    "%d changed\n", g_slist_length(added),
+		    g_slist_length(removed), g_slist_length(changed));
+
+	/* a new message may become the parent of displayed messages or
+	   change the thread date of its root, so rebuild the threads as
+	   summary_show() does */
+	if (item->threaded && added) {
+		procmsg_msg_list_free(added);
+		g_slist_free(removed);
+		g_slist_free(changed);
+		return FALSE;
+	}
+
+	if (changed) {
+		GHashTable *table;
+		GArray *iters;
+		guint i;
+
+		table = g_hash_table_new(NULL, NULL);
+		for (cur = changed; cur != NULL; cur = cur->next)
+			g_hash_table_insert(table, cur->data, cur->data);
+
+		/* collect the rows first because updating a row may move
+		   it in the sorted store */
+		iters = g_array_new(FALSE, FALSE, sizeof(GtkTreeIter));
+		for (valid = gtk_tree_model_get_iter_first(model, &iter);
+		     valid == TRUE; valid = gtkut_tree_model_next(model, &iter)) {
+			gtk_tree_model_get(model, &iter,
+					   S_COL_MSG_INFO, &msginfo, -1);
+			if (g_hash_table_lookup(table, msginfo))
+				g_array_append_val(iters, iter);
+		}
+		for (i = 0; i < iters->len; i++)
+			summary_set_row(summaryview,
+					&g_array_index(iters, GtkTreeIter, i),
+					NULL);
+
+		g_array_free(iters, TRUE);
+		g_hash_table_destroy(table);
+		g_slist_free(changed);
+	}
+
+	if (added) {
+		for (cur = added; cur != NULL; cur = cur->next) {
+			msginfo = (MsgInfo *)cur->data;
+			gtk_tree_store_append(store, &iter, NULL);
+			summary_set_row(summaryview, &iter, msginfo);
+		}
+
+		summaryview->all_mlist =
+			g_slist_concat(summaryview->all_mlist, added);
+		quick_search_clear_index(summaryview->qsearch);
+		item->cache_dirty = TRUE;
+		summary_selection_list_free(summaryview);
+	}
+
+	if (removed) {
+		/* let the usual path remove the rows, the threads and the
+		   selection */
+		for (cur = removed; cur != NULL; cur = cur->next) {
+			msginfo = (MsgInfo *)cur->data;
+			MSG_SET_TMP_FLAGS(msginfo->flags, MSG_INVALID);
+		}
+		g_slist_free(removed);
+		summary_remove_invalid_messages(summaryview);
+	} else {
+		summary_write_cache(summaryview);
+		summary_update_status(summaryview);
+		summary_status_show(summaryview);
+	}
+
+	return TRUE;
+}
+
 void summary_lock(SummaryView *summaryview)
 {
 	summaryview->lock_count++;
@@ -1352,6 +1606,7 @@ static void summary_update_msg_list(SummaryView *summaryview)
 	}
 
 	summaryview->all_mlist = g_slist_reverse(mlist);
+	quick_search_clear_index(summaryview->qsearch);
 
 }
 
@@ -1993,38 +2248,16 @@ static void summary_update_display_state(SummaryView *summaryview,
 	summary_select_by_msgnum(summaryview, sel_msgnum);
 }
 
-static guint attract_hash_func(gconstpointer key)
-{
-	gchar *str;
-	gchar *p;
-	guint h;
-
-	Xstrdup_a(str, (const gchar *)key, return 0);
-	trim_subject_for_compare(str);
-
-	p = str;
-	h = *p;
-
-	if (h) {
-		for (p += 1; *p != '\0'; p++)
-			h = (h << 5) - h + *p;
-	}
-
-	return h;
-}
-
-static gint attract_compare_func(gconstpointer a, gconstpointer b)
-{
-	return subject_compare((const gchar *)a, (const gchar *)b) == 0;
-}
-
 void summary_attract_by_subject(SummaryView *summaryview)
 {
 	GtkTreeModel *model = GTK_TREE_MODEL(summaryview->store);
 	GtkTreeIter iter;
 	MsgInfo *msginfo, *dest_msginfo;
 	GHashTable *subject_table, *order_table;
+	GStringChunk *subject_chunk;
 	GSList *mlist = NULL, *list, *dest, *last = NULL, *next = NULL;
+	gchar *subject;
+	const gchar *key;
 	gboolean valid;
 	gint count, i;
 	gint *new_order;
@@ -2057,8 +2290,9 @@ void summary_attract_by_subject(SummaryView *summaryview)
 
 	mlist = g_slist_reverse(mlist);
 
-	subject_table = g_hash_table_new(attract_hash_func,
-					 attract_compare_func);
+	/* the subjects are normalized only once and hashed as is */
+	subject_table = g_hash_table_new(g_str_hash, g_str_equal);
+	subject_chunk = g_string_chunk_new(4096);
 
 	for (list = mlist; list != NULL; list = next) {
 		msginfo = (MsgInfo *)list->data;
@@ -2070,8 +2304,19 @@ void summary_attract_by_subject(SummaryView *summaryview)
 			continue;
 		}
 
+		subject = g_strdup(msginfo->subject);
+		trim_subject_for_compare(subject);
+		/* empty subjects never match (see subject_compare()) */
+		if (*subject == '\0') {
+			g_free(subject);
+			last = list;
+			continue;
+		}
+		key = g_string_chunk_insert_const(subject_chunk, subject);
+		g_free(subject);
+
 		/* find attracting node */
-		dest = g_hash_table_lookup(subject_table, msginfo->subject);
+		dest = g_hash_table_lookup(subject_table, key);
 
 		if (dest) {
 			dest_msginfo = (MsgInfo *)dest->data;
@@ -2093,10 +2338,11 @@ void summary_attract_by_subject(SummaryView *summaryview)
 		} else
 			last = list;
 
-		g_hash_table_replace(subject_table, msginfo->subject, list);
+		g_hash_table_replace(subject_table, (gchar *)key, list);
 	}
 
 	g_hash_table_destroy(subject_table);
+	g_string_chunk_free(subject_chunk);
 
 	new_order = g_new(gint, count);
 	for (list = mlist, i = 0; list != NULL; list = list->next, ++i) {
@@ -2329,6 +2575,12 @@ void summary_sort(SummaryView *summaryview,
 	item->sort_key = sort_key;
 	item->sort_type = sort_type;
 
+	if (SORT_KEY_IS_STRING(sort_key) &&
+	    sort_key != summaryview->sort_key_type) {
+		summary_unset_sort_column_id(summaryview);
+		summary_set_sort_keys(summaryview, sort_key);
+	}
+
 	gtk_tree_sortable_set_sort_column_id(sortable, col_type,
 					     (GtkSortType)sort_type);
 
@@ -2385,15 +2637,246 @@ static gboolean summary_have_unread_children(SummaryView *summaryview,
 	return FALSE;
 }
 
+/* returns the normalized (trimmed and case-folded) string for sorting by
+   sort_key, so that the comparators only need strcmp() */
+static const gchar *summary_get_sort_key(SummaryView *summaryview,
+					 MsgInfo *msginfo,
+					 FolderSortKey sort_key)
+{
+	gchar *str, *p;
+	const gchar *key;
+
+	switch (sort_key) {
+	case SORT_BY_SUBJECT:
+		if (!msginfo->subject)
+			return NULL;
+		str = g_strdup(msginfo->subject);
+		trim_subject_for_sort(str);
+		break;
+	case SORT_BY_FROM:
+		if (!msginfo->fromname)
+			return NULL;
+		str = g_strdup(msginfo->fromname);
+		break;
+	case SORT_BY_TO:
+		if (msginfo->to)
+			str = procheader_get_toname(msginfo->to);
+		else
+			str = g_strdup("");
+		break;
+	default:
+		return NULL;
+	}
+
+	for (p = str; *p != '\0'; p++)
+		*p = g_ascii_tolower(*p);
+
+	key = g_string_chunk_insert_const(summaryview->sort_key_chunk, str);
+	g_free(str);
+
+	return key;
+}
+
+static gboolean summary_set_sort_key_func(GtkTreeModel *model,
+					  GtkTreePath *path, GtkTreeIter *iter,
+					  gpointer data)
+{
+	SummaryView *summaryview = (SummaryView *)data;
+	MsgInfo *msginfo = NULL;
+
+	gtk_tree_model_get(model, iter, S_COL_MSG_INFO, &msginfo, -1);
+	if (msginfo)
+		gtk_tree_store_set(GTK_TREE_STORE(model), iter,
+				   S_COL_SORT_KEY,
+				   summary_get_sort_key
+					(summaryview, msginfo,
+					 summaryview->sort_key_type),
+				   -1);
+
+	return FALSE;
+}
+
+/* the store must not be sorted while the keys are replaced */
+static void summary_set_sort_keys(SummaryView *summaryview,
+				  FolderSortKey sort_key)
+{
+	summaryview->sort_key_type = sort_key;
+	gtk_tree_model_foreach(GTK_TREE_MODEL(summaryview->store),
+			       summary_set_sort_key_func, summaryview);
+}
+
+typedef struct _SummarySortEntry
+{
+	MsgInfo *msginfo;
+	const gchar *key;
+} SummarySortEntry;
+
+/* must give the same order as the summary_cmp_by_*() functions */
+static gint summary_sort_entry_cmp(gconstpointer a, gconstpointer b,
+				   gpointer data)
+{
+	const SummarySortEntry *ea = (const SummarySortEntry *)a;
+	const SummarySortEntry *eb = (const SummarySortEntry *)b;
+	MsgInfo *msginfo_a = ea->msginfo, *msginfo_b = eb->msginfo;
+	FolderItem *item = (FolderItem *)data;
+	gint ret;
+
+	switch (item->sort_key) {
+	case SORT_BY_MARK:
+		ret = MSG_IS_MARKED(msginfo_a->flags) -
+			MSG_IS_MARKED(msginfo_b->flags);
+		break;
+	case SORT_BY_UNREAD:
+		ret = MSG_IS_UNREAD(msginfo_a->flags) -
+			MSG_IS_UNREAD(msginfo_b->flags);
+		break;
+	case SORT_BY_MIME:
+		ret = MSG_IS_MIME(msginfo_a->flags) -
+			MSG_IS_MIME(msginfo_b->flags);
+		break;
+	case SORT_BY_LABEL:
+		ret = MSG_GET_COLORLABEL(msginfo_a->flags) -
+			MSG_GET_COLORLABEL(msginfo_b->flags);
+		break;
+	case SORT_BY_SIZE:
+		ret = msginfo_a->size - msginfo_b->size;
+		break;
+	case SORT_BY_NUMBER:
+		ret = msginfo_a->msgnum - msginfo_b->msgnum;
+		return item->sort_type == SORT_ASCENDING ? ret : -ret;
+	case SORT_BY_SUBJECT:
+	case SORT_BY_FROM:
+	case SORT_BY_TO:
+		if (ea->key == NULL)
+			ret = -(eb->key != NULL);
+		else if (eb->key == NULL)
+			ret = 1;
+		else
+			ret = strcmp(ea->key, eb->key);
+		if (ea->key == NULL || eb->key == NULL)
+			return item->sort_type == SORT_ASCENDING ? ret : -ret;
+		break;
+	default:
+		ret = 0;
+		break;
+	}
+
+	if (ret == 0)
+		ret = msginfo_a->date_t - msginfo_b->date_t;
+
+	return item->sort_type == SORT_ASCENDING ? ret : -ret;
+}
+
+/* returns a new list sorted by the sort key of the current folder, computing
+   each key only once, so that the tree store is populated in the final
+   order and sorting it afterwards is cheap */
+static GSList *summary_sort_mlist(SummaryView *summaryview, GSList *mlist)
+{
+	FolderItem *item = summaryview->folder_item;
+	SummarySortEntry *entries;
+	GSList *cur, *sorted = NULL;
+	guint len, i;
+
+	len = g_slist_length(mlist);
+	if (len < 2 || item->sort_key == SORT_BY_NONE ||
+	    sort_key_to_col[item->sort_key] == -1 ||
+	    item->sort_key == SORT_BY_TDATE)
+		return g_slist_copy(mlist);
+
+	entries = g_new(SummarySortEntry, len);
+	for (cur = mlist, i = 0; cur != NULL; cur = cur->next, i++) {
+		entries[i].msginfo = (MsgInfo *)cur->data;
+		entries[i].key = summary_get_sort_key
+			(summaryview, entries[i].msginfo, item->sort_key);
+	}
+
+	g_qsort_with_data(entries, len, sizeof(SummarySortEntry),
+			  summary_sort_entry_cmp, item);
+
+	for (i = len; i > 0; i--)
+		sorted = g_slist_prepend(sorted, entries[i - 1].msginfo);
+	g_free(entries);
+
+	return sorted;
+}
+
+/* the text columns are not stored in the tree store but formatted here on
+   demand, so that only the visible rows are formatted */
+static void summary_text_cell_data_func(GtkTreeViewColumn *column,
+					GtkCellRenderer *renderer,
+					GtkTreeModel *model, GtkTreeIter *iter,
+					gpointer data)
+{
+	SummaryView *summaryview = (SummaryView *)data;
+	SummaryColumnType type;
+	MsgInfo *msginfo = NULL;
+	gchar date_modified[80];
+	const gchar *text = NULL;
+	gchar *str = NULL;
+
+	type = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(column),
+						 "column_id"));
+	gtk_tree_model_get(model, iter, S_COL_MSG_INFO, &msginfo, -1);
+	if (!msginfo) {
+		g_object_set(renderer, "text", NULL, NULL);
+		return;
+	}
+
+	switch (type) {
+	case S_COL_SUBJECT:
+		if (msginfo->subject && msginfo->folder &&
+		    msginfo->folder->trim_summary_subject) {
+			str = g_strdup(msginfo->subject);
+			trim_subject(str);
+		} else
+			text = msginfo->subject ? msginfo->subject :
+				_("(No Subject)");
+		break;
+	case S_COL_FROM:
+		if (prefs_common.swap_from && msginfo->from && msginfo->to) {
+			gchar *from;
+
+			Xstrdup_a(from, msginfo->from, return);
+			extract_address(from);
+			if (account_address_exist(from))
+				str = g_strconcat("-->", msginfo->to, NULL);
+		}
+		if (!str)
+			text = msginfo->fromname ? msginfo->fromname :
+				_("(No From)");
+		break;
+	case S_COL_DATE:
+		if (msginfo->date_t) {
+			procheader_date_get_localtime(date_modified,
+						      sizeof(date_modified),
+						      msginfo->date_t);
+			text = date_modified;
+		} else if (msginfo->date)
+			text = msginfo->date;
+		else
+			text = _("(No Date)");
+		break;
+	case S_COL_SIZE:
+		text = to_human_readable(msginfo->size);
+		break;
+	case S_COL_TO:
+		if (msginfo->to)
+			str = procheader_get_toname(msginfo->to);
+		else
+			text = "";
+		break;
+	default:
+		break;
+	}
+
+	g_object_set(renderer, "text", str ? str : text, NULL);
+	g_free(str);
+}
+
 static void summary_set_row(SummaryView *summaryview, GtkTreeIter *iter,
 			    MsgInfo *msginfo)
 {
 	GtkTreeStore *store = GTK_TREE_STORE(summaryview->store);
-	gchar date_modified[80];
-	const gchar *date_s;
-	gchar *sw_from_s = NULL;
-	gchar *subject_s = NULL;
-	gchar *to_s = NULL;
 	GdkPixbuf *mark_pix = NULL;
 	GdkPixbuf *unread_pix = NULL;
 	GdkPixbuf *mime_pix = NULL;
@@ -2407,34 +2890,6 @@ static void summary_set_row(SummaryView *summaryview, GtkTreeIter *iter,
 		GET_MSG_INFO(msginfo, iter);
 	}
 
-	if (msginfo->date_t) {
-		procheader_date_get_localtime(date_modified,
-					      sizeof(date_modified),
-					      msginfo->date_t);
-		date_s = date_modified;
-	} else if (msginfo->date)
-		date_s = msginfo->date;
-	else
-		date_s = _("(No Date)");
-	if (prefs_common.swap_from && msginfo->from && msginfo->to) {
-		gchar *from;
-
-		Xstrdup_a(from, msginfo->from, return);
-		extract_address(from);
-		if (account_address_exist(from))
-			sw_from_s = g_strconcat("-->", msginfo->to, NULL);
-	}
-
-	if (msginfo->subject) {
-		if (msginfo->folder && msginfo->folder->trim_summary_subject) {
-			subject_s = g_strdup(msginfo->subject);
-			trim_subject(subject_s);
-		}
-	}
-
-	if (msginfo->to)
-		to_s = procheader_get_toname(msginfo->to);
-
 	flags = msginfo->flags;
 
 	/* set flag pixbufs */
@@ -2489,16 +2944,7 @@ static void summary_set_row(SummaryView *summaryview, GtkTreeIter *iter,
 			   S_COL_MARK, mark_pix,
 			   S_COL_UNREAD, unread_pix,
 			   S_COL_MIME, mime_pix,
-			   S_COL_SUBJECT, subject_s ? subject_s :
-			   		  msginfo->subject ? msginfo->subject :
-					  _("(No Subject)"),
-			   S_COL_FROM, sw_from_s ? sw_from_s :
-			   	       msginfo->fromname ? msginfo->fromname :
-				       _("(No From)"),
-			   S_COL_DATE, date_s,
-			   S_COL_SIZE, to_human_readable(msginfo->size),
 			   S_COL_NUMBER, msginfo->msgnum,
-			   S_COL_TO, to_s ? to_s : "",
 
 			   S_COL_MSG_INFO, msginfo,
 
@@ -2506,14 +2952,11 @@ static void summary_set_row(SummaryView *summaryview, GtkTreeIter *iter,
 
 			   S_COL_FOREGROUND, foreground,
 			   S_COL_BOLD, weight,
-			   -1);
 
-	if (to_s)
-		g_free(to_s);
-	if (subject_s)
-		g_free(subject_s);
-	if (sw_from_s)
-		g_free(sw_from_s);
+			   S_COL_SORT_KEY, summary_get_sort_key
+				(summaryview, msginfo,
+				 summaryview->sort_key_type),
+			   -1);
 }
 
 static void summary_insert_gnode(SummaryView *summaryview, GtkTreeStore *store,
@@ -2576,6 +3019,7 @@ static void summary_set_tree_model_from_list(SummaryView *summaryview,
 	GtkTreeStore *store = GTK_TREE_STORE(summaryview->store);
 	GtkTreeIter iter;
 	MsgInfo *msginfo;
+	GSList *sorted_mlist;
 	GSList *cur;
 
 	debug_print(_("\tSetting summary from message data..."));
@@ -2586,10 +3030,20 @@ static void summary_set_tree_model_from_list(SummaryView *summaryview,
 	/* temporarily remove the model for speed up */
 	gtk_tree_view_set_model(GTK_TREE_VIEW(summaryview->treeview), NULL);
 
+	/* the store is empty here, so no row refers to the old keys */
+	g_string_chunk_free(summaryview->sort_key_chunk);
+	summaryview->sort_key_chunk = g_string_chunk_new(4096);
+	if (SORT_KEY_IS_STRING(summaryview->folder_item->sort_key))
+		summaryview->sort_key_type = summaryview->folder_item->sort_key;
+	else
+		summaryview->sort_key_type = SORT_BY_NONE;
+
+	sorted_mlist = summary_sort_mlist(summaryview, mlist);
+
 	if (summaryview->folder_item->threaded) {
 		GNode *root, *gnode;
 
-		root = procmsg_get_thread_tree(mlist);
+		root = procmsg_get_thread_tree(sorted_mlist);
 
 		for (gnode = root->children; gnode != NULL;
 		     gnode = gnode->next) {
@@ -2621,7 +3075,8 @@ static void summary_set_tree_model_from_list(SummaryView *summaryview,
 		GSList *rev_mlist;
 		GtkTreeIter iter;
 
-		rev_mlist = g_slist_reverse(g_slist_copy(mlist));
+		rev_mlist = g_slist_reverse(sorted_mlist);
+		sorted_mlist = NULL;
 		for (cur = rev_mlist; cur != NULL; cur = cur->next) {
 			msginfo = (MsgInfo *)cur->data;
 
@@ -2639,6 +3094,8 @@ static void summary_set_tree_model_from_list(SummaryView *summaryview,
 		g_slist_free(rev_mlist);
 	}
 
+	g_slist_free(sorted_mlist);
+
 	gtk_tree_view_set_model(GTK_TREE_VIEW(summaryview->treeview),
 				GTK_TREE_MODEL(store));
 
@@ -2671,6 +3128,8 @@ gint summary_write_cache(SummaryView *summaryview)
 	item = summaryview->folder_item;
 	if (!item || !item->path)
 		return -1;
+	if (item->stype != F_VIRTUAL)
+		procmime_write_mime_cache(item, summaryview->all_mlist);
 	if (item->mark_queue)
 		item->mark_dirty = TRUE;
 	if (!item->cache_dirty && !item->mark_dirty)
@@ -3110,11 +3569,89 @@ static void summary_mark_row_as_read(SummaryView *summaryview,
 	}
 }
 
+/* Marks the rows as read at once: the flags and the folder counters are
+   changed in one batch (with one STORE per IMAP folder), and only the
+   changed rows and folders are redrawn. */
+static void summary_mark_rows_as_read(SummaryView *summaryview,
+				      GArray *iters)
+{
+	FolderItem *item = summaryview->folder_item;
+	GArray *changed_iters;
+	GSList *mlist = NULL, *changed;
+	GHashTable *folder_table = NULL;
+	GtkTreeIter *iter;
+	MsgInfo *msginfo;
+	gboolean new_changed = FALSE;
+	guint i;
+
+	changed_iters = g_array_new(FALSE, FALSE, sizeof(GtkTreeIter));
+	if (item->stype == F_VIRTUAL)
+		folder_table = g_hash_table_new(NULL, NULL);
+
+	for (i = 0; i < iters->len; i++) {
+		iter = &g_array_index(iters, GtkTreeIter, i);
+		GET_MSG_INFO(msginfo, iter);
+
+		if (!MSG_IS_NEW(msginfo->flags) &&
+		    !MSG_IS_UNREAD(msginfo->flags))
+			continue;
+
+		/* the counters of the source folders are updated by
+		   procmsg_change_flags_for_msg_list() */
+		if (MSG_IS_NEW(msginfo->flags)) {
+			if (folder_table && item->new > 0)
+				item->new--;
+			if (summaryview->on_filter && summaryview->flt_new > 0)
+				summaryview->flt_new--;
+			new_changed = TRUE;
+		}
+		if (MSG_IS_UNREAD(msginfo->flags)) {
+			if (folder_table && item->unread > 0)
+				item->unread--;
+			if (summaryview->on_filter &&
+			    summaryview->flt_unread > 0)
+				summaryview->flt_unread--;
+		}
+		if (folder_table)
+			g_hash_table_insert(folder_table, msginfo->folder,
+					    msginfo->folder);
+
+		mlist = g_slist_prepend(mlist, msginfo);
+		g_array_append_val(changed_iters, *iter);
+	}
+
+	mlist = g_slist_reverse(mlist);
+	changed = procmsg_change_flags_for_msg_list(mlist, 0,
+						    MSG_NEW | MSG_UNREAD);
+	debug_print("summary_mark_rows_as_read: %d messages marked as read\n",
+		    g_slist_length(changed));
+	/* the flags of a virtual folder are written through its own item */
+	if (changed)
+		item->mark_dirty = TRUE;
+	g_slist_free(changed);
+	g_slist_free(mlist);
+
+	if (new_changed)
+		inc_block_notify(TRUE);
+
+	for (i = 0; i < changed_iters->len; i++) {
+		iter = &g_array_index(changed_iters, GtkTreeIter, i);
+		summary_set_row(summaryview, iter, NULL);
+	}
+	g_array_free(changed_iters, TRUE);
+
+	if (folder_table) {
+		folderview_update_item_foreach(folder_table, FALSE);
+		g_hash_table_destroy(folder_table);
+	}
+}
+
 void summary_mark_as_read(SummaryView *summaryview)
 {
 	GList *rows, *cur;
 	GtkTreeModel *model = GTK_TREE_MODEL(summaryview->store);
 	GtkTreeIter iter;
+	GArray *iters;
 	FolderSortKey sort_key = SORT_BY_NONE;
 	FolderSortType sort_type = SORT_ASCENDING;
 
@@ -3125,21 +3662,17 @@ void summary_mark_as_read(SummaryView *summaryview)
 	SORT_BLOCK(SORT_BY_UNREAD);
 
 	rows = summary_get_selected_rows(summaryview);
+	iters = g_array_new(FALSE, FALSE, sizeof(GtkTreeIter));
 
 	for (cur = rows; cur != NULL; cur = cur->next) {
 		GtkTreePath *path = (GtkTreePath *)cur->data;
 
 		gtk_tree_model_get_iter(model, &iter, path);
-		summary_mark_row_as_read(summaryview, &iter);
+		g_array_append_val(iters, iter);
 	}
 
-	if (FOLDER_TYPE(summaryview->folder_item->folder) == F_IMAP) {
-		GSList *msglist;
-
-		msglist = summary_get_selected_msg_list(summaryview);
-		imap_msg_list_unset_perm_flags(msglist, MSG_NEW | MSG_UNREAD);
-		g_slist_free(msglist);
-	}
+	summary_mark_rows_as_read(summaryview, iters);
+	g_array_free(iters, TRUE);
 
 	SORT_UNBLOCK(SORT_BY_UNREAD);
 
@@ -3169,7 +3702,7 @@ void summary_mark_thread_as_read(SummaryView *summaryview)
 	GtkTreePath *path, *top_path;
 	GHashTable *row_table;
 	MsgInfo *msginfo;
-	GSList *msglist = NULL;
+	GArray *iters;
 	FolderSortKey sort_key = SORT_BY_NONE;
 	FolderSortType sort_type = SORT_ASCENDING;
 
@@ -3204,13 +3737,14 @@ void summary_mark_thread_as_read(SummaryView *summaryview)
 
 	g_hash_table_destroy(row_table);
 
+	iters = g_array_new(FALSE, FALSE, sizeof(GtkTreeIter));
 	for (s_cur = thr_rows; s_cur != NULL; s_cur = s_cur->next) {
 		path = (GtkTreePath *)s_cur->data;
 		gtk_tree_model_get_iter(model, &iter, path);
-		summary_mark_row_as_read(summaryview, &iter);
-		gtk_tree_model_get(model, &iter, S_COL_MSG_INFO, &msginfo, -1);
-		msglist = g_slist_prepend(msglist, msginfo);
+		g_array_append_val(iters, iter);
 	}
+	summary_mark_rows_as_read(summaryview, iters);
+	g_array_free(iters, TRUE);
 
 	if (prefs_common.bold_unread) {
 		for (s_cur = top_rows; s_cur != NULL; s_cur = s_cur->next) {
@@ -3225,13 +3759,6 @@ void summary_mark_thread_as_read(SummaryView *summaryview)
 			}
 		}
 	}
-	msglist = g_slist_reverse(msglist);
-
-	if (FOLDER_TYPE(summaryview->folder_item->folder) == F_IMAP) {
-		imap_msg_list_unset_perm_flags(msglist, MSG_NEW | MSG_UNREAD);
-	}
-
-	g_slist_free(msglist);
 	g_slist_foreach(top_rows, (GFunc)gtk_tree_path_free, NULL);
 	g_slist_free(top_rows);
 	g_slist_foreach(thr_rows, (GFunc)gtk_tree_path_free, NULL);
@@ -3249,6 +3776,7 @@ void summary_mark_all_read(SummaryView *summaryview)
 	GtkTreeModel *model = GTK_TREE_MODEL(summaryview->store);
 	GtkTreeIter iter;
 	gboolean valid;
+	GArray *iters;
 	FolderSortKey sort_key = SORT_BY_NONE;
 	FolderSortType sort_type = SORT_ASCENDING;
 
@@ -3258,18 +3786,18 @@ void summary_mark_all_read(SummaryView *summaryview)
 
 	SORT_BLOCK(SORT_BY_UNREAD);
 
-	if (FOLDER_TYPE(summaryview->folder_item->folder) == F_IMAP) {
-		GSList *msglist;
-		msglist = summary_get_flagged_msg_list(summaryview,
-						       MSG_NEW | MSG_UNREAD);
-		imap_msg_list_unset_perm_flags(msglist, MSG_NEW | MSG_UNREAD);
-		g_slist_free(msglist);
-	}
-
+	iters = g_array_new(FALSE, FALSE, sizeof(GtkTreeIter));
 	valid = gtk_tree_model_get_iter_first(model, &iter);
 	while (valid) {
-		summary_mark_row_as_read(summaryview, &iter);
-		if (prefs_common.bold_unread) {
+		g_array_append_val(iters, iter);
+		valid = gtkut_tree_model_next(model, &iter);
+	}
+	summary_mark_rows_as_read(summaryview, iters);
+	g_array_free(iters, TRUE);
+
+	if (prefs_common.bold_unread) {
+		valid = gtk_tree_model_get_iter_first(model, &iter);
+		while (valid) {
 			if (gtk_tree_model_iter_has_child(model, &iter)) {
 				GtkTreePath *path;
 
@@ -3283,8 +3811,8 @@ void summary_mark_all_read(SummaryView *summaryview)
 						 PANGO_WEIGHT_NORMAL, -1);
 				gtk_tree_path_free(path);
 			}
+			valid = gtkut_tree_model_next(model, &iter);
 		}
-		valid = gtkut_tree_model_next(model, &iter);
 	}
 
 	SORT_UNBLOCK(SORT_BY_UNREAD);
@@ -3995,6 +4523,7 @@ static void summary_remove_invalid_messages(SummaryView *summaryview)
 		gtk_tree_store_remove(GTK_TREE_STORE(model), &iter);
 		summaryview->all_mlist = g_slist_remove(summaryview->all_mlist,
 							msginfo);
+		quick_search_clear_index(summaryview->qsearch);
 		if (summaryview->flt_mlist)
 			summaryview->flt_mlist =
 				g_slist_remove(summaryview->flt_mlist, msginfo);
@@ -4484,6 +5013,7 @@ static GNode *summary_get_modified_node(SummaryView *summaryview,
 	} else {
 		summaryview->all_mlist = g_slist_remove(summaryview->all_mlist,
 							msginfo);
+		quick_search_clear_index(summaryview->qsearch);
 		if (summaryview->flt_mlist)
 			summaryview->flt_mlist =
 				g_slist_remove(summaryview->flt_mlist, msginfo);
@@ -5309,7 +5839,9 @@ static GtkWidget *summary_tree_view_create(SummaryView *summaryview)
 				   G_TYPE_UINT,
 
 				   GDK_TYPE_COLOR,
-				   G_TYPE_INT);
+				   G_TYPE_INT,
+
+				   G_TYPE_POINTER);
 
 #define SET_SORT(col, func)						\
 	gtk_tree_sortable_set_sort_func(GTK_TREE_SORTABLE(store),	\
@@ -5393,20 +5925,39 @@ static GtkWidget *summary_tree_view_create(SummaryView *summaryview)
 	gtk_widget_show(image);
 	gtk_tree_view_column_set_widget(column, image);
 
+/* the text is formatted by summary_text_cell_data_func() */
+#define SET_CELL_DATA_FUNC()						\
+{									\
+	gtk_tree_view_column_set_attributes				\
+		(column, renderer,					\
+		 "foreground-gdk", S_COL_FOREGROUND,			\
+		 "weight", S_COL_BOLD,					\
+		 NULL);							\
+	gtk_tree_view_column_set_cell_data_func				\
+		(column, renderer, summary_text_cell_data_func,		\
+		 summaryview, NULL);					\
+}
+
 	ADD_COLUMN(_("Subject"), text, S_COL_SUBJECT, TRUE,
 		   prefs_common.summary_col_size[S_COL_SUBJECT], 0.0);
+	SET_CELL_DATA_FUNC();
 	gtk_tree_view_set_expander_column(GTK_TREE_VIEW(treeview), column);
 	ADD_COLUMN(_("From"), text, S_COL_FROM, TRUE,
 		   prefs_common.summary_col_size[S_COL_FROM], 0.0);
+	SET_CELL_DATA_FUNC();
 	ADD_COLUMN(_("Date"), text, S_COL_DATE, TRUE,
 		   prefs_common.summary_col_size[S_COL_DATE], 0.0);
+	SET_CELL_DATA_FUNC();
 	ADD_COLUMN(_("Size"), text, S_COL_SIZE, TRUE,
 		   prefs_common.summary_col_size[S_COL_SIZE], 1.0);
+	SET_CELL_DATA_FUNC();
 	ADD_COLUMN(_("No."), text, S_COL_NUMBER, TRUE,
 		   prefs_common.summary_col_size[S_COL_NUMBER], 1.0);
 	ADD_COLUMN(_("To"), text, S_COL_TO, TRUE,
 		   prefs_common.summary_col_size[S_COL_TO], 0.0);
+	SET_CELL_DATA_FUNC();
 
+#undef SET_CELL_DATA_FUNC
 #undef ADD_COLUMN
 
 	g_object_set_data(G_OBJECT(treeview), "user_data", summaryview);
@@ -5694,6 +6245,14 @@ void summary_mark_displayed_read(SummaryView *summaryview, GtkTreeIter *iter)
 
 /* callback functions */
 
+static void summary_destroy(GtkWidget *widget, SummaryView *summaryview)
+{
+	if (summaryview->sort_key_chunk) {
+		g_string_chunk_free(summaryview->sort_key_chunk);
+		summaryview->sort_key_chunk = NULL;
+	}
+}
+
 static gboolean summary_toggle_pressed(GtkWidget *eventbox,
 				       GdkEventButton *event,
 				       SummaryView *summaryview)
@@ -6390,83 +6949,36 @@ static gint summary_cmp_by_thread_date(GtkTreeModel *model,
 		return tdate_a - tdate_b;
 }
 
-#define CMP_FUNC_DEF(func_name, var_name)				\
+/* compare the keys set by summary_get_sort_key() */
+#define CMP_FUNC_DEF(func_name)						\
 static gint func_name(GtkTreeModel *model,				\
 		      GtkTreeIter *a, GtkTreeIter *b, gpointer data)	\
 {									\
 	MsgInfo *msginfo_a = NULL, *msginfo_b = NULL;			\
+	const gchar *key_a = NULL, *key_b = NULL;			\
 	gint ret;							\
 									\
-	gtk_tree_model_get(model, a, S_COL_MSG_INFO, &msginfo_a, -1);	\
-	gtk_tree_model_get(model, b, S_COL_MSG_INFO, &msginfo_b, -1);	\
+	gtk_tree_model_get(model, a, S_COL_MSG_INFO, &msginfo_a,	\
+			   S_COL_SORT_KEY, &key_a, -1);			\
+	gtk_tree_model_get(model, b, S_COL_MSG_INFO, &msginfo_b,	\
+			   S_COL_SORT_KEY, &key_b, -1);			\
 									\
 	if (!msginfo_a || !msginfo_b)					\
 		return 0;						\
 									\
-	if (msginfo_a->var_name == NULL)				\
-		return -(msginfo_b->var_name != NULL);			\
-	if (msginfo_b->var_name == NULL)				\
-		return (msginfo_a->var_name != NULL);			\
+	if (key_a == NULL)						\
+		return -(key_b != NULL);				\
+	if (key_b == NULL)						\
+		return (key_a != NULL);					\
 									\
-	ret = g_ascii_strcasecmp					\
-		(msginfo_a->var_name, msginfo_b->var_name);		\
+	ret = strcmp(key_a, key_b);					\
 									\
 	return (ret != 0) ? ret :					\
 		(msginfo_a->date_t - msginfo_b->date_t);		\
 }
 
-CMP_FUNC_DEF(summary_cmp_by_from, fromname)
+CMP_FUNC_DEF(summary_cmp_by_from)
+CMP_FUNC_DEF(summary_cmp_by_to)
+CMP_FUNC_DEF(summary_cmp_by_subject)
 
 #undef CMP_FUNC_DEF
-
-static gint summary_cmp_by_to(GtkTreeModel *model,
-				   GtkTreeIter *a, GtkTreeIter *b,
-				   gpointer data)
-{
-	MsgInfo *msginfo_a = NULL, *msginfo_b = NULL;
-	gchar *to_a = NULL, *to_b = NULL;
-	gint ret;
-
-	gtk_tree_model_get(model, a, S_COL_MSG_INFO, &msginfo_a,
-			   S_COL_TO, &to_a, -1);
-	gtk_tree_model_get(model, b, S_COL_MSG_INFO, &msginfo_b,
-			   S_COL_TO, &to_b, -1);
-
-	if (!msginfo_a || !msginfo_b) {
-		g_free(to_b);
-		g_free(to_a);
-		return 0;
-	}
-
-	ret = g_ascii_strcasecmp(to_a ? to_a : "", to_b ? to_b : "");
-
-	g_free(to_b);
-	g_free(to_a);
-
-	return (ret != 0) ? ret :
-		(msginfo_a->date_t - msginfo_b->date_t);
-}
-
-static gint summary_cmp_by_subject(GtkTreeModel *model,
-				   GtkTreeIter *a, GtkTreeIter *b,
-				   gpointer data)
-{
-	MsgInfo *msginfo_a = NULL, *msginfo_b = NULL;
-	gint ret;
-
-	gtk_tree_model_get(model, a, S_COL_MSG_INFO, &msginfo_a, -1);
-	gtk_tree_model_get(model, b, S_COL_MSG_INFO, &msginfo_b, -1);
-
-	if (!msginfo_a || !msginfo_b)
-		return 0;
-
-	if (msginfo_a->subject == NULL)
-		return -(msginfo_b->subject != NULL);
-	if (msginfo_b->subject == NULL)
-		return (msginfo_a->subject != NULL);
-
-	ret = subject_compare_for_sort(msginfo_a->subject, msginfo_b->subject);
-
-	return (ret != 0) ? ret :
-		(msginfo_a->date_t - msginfo_b->date_t);
-}
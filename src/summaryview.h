@@ -127,6 +127,10 @@ private:
 	/* filtered message list */
 	GSList *flt_mlist;
 
+	/* normalized sort keys referred from S_COL_SORT_KEY */
+	GStringChunk *sort_key_chunk;
+	FolderSortKey sort_key_type;
+
 	gint64 total_flt_msg_size;
 	gint flt_msg_total;
 	gint flt_deleted;